@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "edge-cover.h"
+#include "guide.h"
+
+/*
+ * guide-cmin: distill a corpus of test cases carrying saved choices
+ * (see README.md) down to a subset with the same decision-tree
+ * coverage, without running the target. think of it as a cheap
+ * filter to run before afl-cmin.
+ *
+ * coverage is counted in edges, identified by the last K values
+ * before each choice (see edge-cover.h); K is 4 by default. the
+ * subset is picked greedily, preferring smaller files. files without
+ * saved choices are kept, since there's no telling what they cover,
+ * and files that can't be read are left out
+ */
+
+/////////////////////////////////////////////////////////////////////////////////////
+
+namespace fs = std::filesystem;
+
+struct TestCase {
+  std::string Name;
+  uint64_t Size = 0;
+  // sorted and deduplicated
+  std::vector<uint64_t> Edges;
+  bool Readable = false, Parsed = false;
+  explicit TestCase(std::string _Name) : Name(std::move(_Name)) {}
+};
+
+static void usage() {
+  std::cerr << "usage: guide-cmin [-p prefix] [-k context] [-j threads] -o "
+               "outdir input...\n\n"
+               "inputs are files or directories of them; the comment prefix\n"
+               "defaults to FILEGUIDE_COMMENT_PREFIX\n";
+  exit(-1);
+}
+
+/*
+ * a numeric option, raised to Min if it's smaller; anything that
+ * isn't a number that fits in an unsigned gets the usage message
+ */
+static unsigned number(const char *Str, unsigned Min) {
+  char *End;
+  errno = 0;
+  unsigned long N = strtoul(Str, &End, 10);
+  // strtoul() would quietly negate a number with a minus sign
+  if (errno != 0 || End == Str || *End != '\0' ||
+      std::string(Str).find('-') != std::string::npos || N > UINT_MAX)
+    usage();
+  return std::max(Min, (unsigned)N);
+}
+
+static void load(TestCase &T, const std::string &Prefix, unsigned K) {
+  std::ifstream Inf(T.Name, std::ios::binary);
+  if (!Inf.is_open())
+    return;
+  std::string Str((std::istreambuf_iterator<char>(Inf)),
+                  std::istreambuf_iterator<char>());
+  if (Inf.bad())
+    return;
+  T.Readable = true;
+  T.Size = Str.size();
+  std::vector<tree_guide::rec> Choices;
+  if (!tree_guide::FileGuide::parseChoices(Str.data(), Str.size(), Prefix,
+                                           Choices))
+    return;
+  T.Edges = tree_guide::contextEdges(Choices, K);
+  T.Parsed = true;
+}
+
+int main(int argc, char *argv[]) {
+  std::string Prefix, OutDir;
+  if (auto P = getenv("FILEGUIDE_COMMENT_PREFIX"))
+    Prefix = P;
+  unsigned K = 4, Threads = std::max(1u, std::thread::hardware_concurrency());
+  int Opt;
+  while ((Opt = getopt(argc, argv, "p:k:j:o:")) != -1) {
+    switch (Opt) {
+    case 'p':
+      Prefix = optarg;
+      break;
+    case 'k':
+      K = number(optarg, 0);
+      break;
+    case 'j':
+      Threads = number(optarg, 1);
+      break;
+    case 'o':
+      OutDir = optarg;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (Prefix.empty() || OutDir.empty() || optind == argc)
+    usage();
+
+  std::vector<TestCase> Tests;
+  for (int i = optind; i < argc; ++i) {
+    fs::path P(argv[i]);
+    if (fs::is_directory(P)) {
+      for (auto &E : fs::directory_iterator(P))
+        if (E.is_regular_file())
+          Tests.emplace_back(E.path().string());
+    } else {
+      Tests.emplace_back(P.string());
+    }
+  }
+
+  std::atomic<size_t> Next(0);
+  auto Worker = [&] {
+    for (size_t I = Next++; I < Tests.size(); I = Next++)
+      load(Tests[I], Prefix, K);
+  };
+  std::vector<std::thread> Pool;
+  for (unsigned T = 1; T < Threads; ++T)
+    Pool.emplace_back(Worker);
+  Worker();
+  for (auto &Th : Pool)
+    Th.join();
+
+  std::vector<std::vector<uint64_t>> Edges;
+  std::vector<uint64_t> Sizes;
+  for (auto &T : Tests) {
+    Edges.push_back(T.Edges);
+    Sizes.push_back(T.Size);
+  }
+  uint64_t Covered;
+  auto Chosen = tree_guide::greedyCover(Edges, Sizes, Covered);
+  uint64_t Unparsed = 0, Unreadable = 0;
+  for (size_t I = 0; I < Tests.size(); ++I) {
+    if (!Tests[I].Readable) {
+      std::cerr << "warning: can't read " << Tests[I].Name << "\n";
+      ++Unreadable;
+    } else if (!Tests[I].Parsed) {
+      std::cerr << "warning: no choices in " << Tests[I].Name << "\n";
+      Chosen.push_back(I);
+      ++Unparsed;
+    }
+  }
+
+  // inputs from different directories can have the same name (such
+  // as AFL++'s id:NNNNNN files), so later ones get a suffix
+  fs::create_directories(OutDir);
+  std::unordered_set<std::string> Names;
+  uint64_t Kept = 0;
+  for (auto I : Chosen) {
+    auto From = fs::path(Tests[I].Name);
+    auto Name = From.filename().string();
+    for (int N = 1; !Names.insert(Name).second; ++N)
+      Name = From.filename().string() + "," + std::to_string(N);
+    std::error_code EC;
+    fs::copy_file(From, fs::path(OutDir) / Name,
+                  fs::copy_options::overwrite_existing, EC);
+    if (EC) {
+      std::cerr << "warning: can't copy " << Tests[I].Name << ": "
+                << EC.message() << "\n";
+      continue;
+    }
+    ++Kept;
+  }
+  std::cout << "kept " << Kept << " of " << Tests.size()
+            << " test cases, covering " << Covered << " edges (" << Unparsed
+            << " kept for having no choices, " << Unreadable
+            << " unreadable)\n";
+  return 0;
+}
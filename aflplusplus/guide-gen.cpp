@@ -2,8 +2,18 @@ extern "C" {
 #include "afl-fuzz.h"
 }
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
+#include <pthread.h>
+#include <signal.h>
+
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,16 +36,165 @@ struct my_mutator {
 
 std::string Prefix, Generator, ExtraCommand;
 
+// the queue entry that stands for each path; other entries with the
+// same path are structurally redundant, so we don't spend time
+// fuzzing them
+static std::unordered_map<uint64_t, std::string> Representative;
+static uint64_t SkippedEntries = 0;
+// the prefetch workers count these too
+static std::atomic<uint64_t> DuplicateMutants(0);
+
+// the number of mutants for a queue entry with average novelty (256
+// is what AFL++ does by default), and the running average
+static uint32_t BaseFuzzCount = 256;
+static double NoveltyTotal = 0.0;
+static uint64_t NoveltyCount = 0;
+
+// background mutant generation; null unless FILEGUIDE_PREFETCH asks
+// for workers. afl_custom_deinit() stops the workers, waits for them
+// and deletes it
+class Prefetcher;
+static Prefetcher *Prefetch = nullptr;
+static void startPrefetch(unsigned Threads);
+
+// background runs of FILEGUIDE_EXTRA_COMMAND; null if there isn't
+// one, or if FILEGUIDE_EXTRA_JOBS is 0
+class CheckerPool;
+static CheckerPool *Checkers = nullptr;
+static void startCheckers(unsigned Threads, size_t Capacity);
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * where the time goes: a count and a total time for each stage of
+ * making a mutant, along with a few counters, all of which get
+ * appended to fileguide_stats in AFL++'s output directory every
+ * FILEGUIDE_STATS_INTERVAL seconds (by default 5, which is how often
+ * AFL++ writes plot_data). each line starts with the same
+ * relative_time as plot_data, so the two files can be joined on it;
+ * like plot_data's, the values are running totals. the prefetch
+ * workers update these too, hence the atomics
+ */
+
+enum StageId {
+  PARSE,
+  MUTATE,
+  SPAWN,
+  GENERATOR,
+  EXTRA,
+  EXTRA_WAIT,
+  READBACK,
+  NUM_STAGES
+};
+
+struct Stage {
+  const char *Name;
+  std::atomic<uint64_t> Count{0}, Nanos{0};
+};
+
+static Stage Stages[NUM_STAGES] = {
+    {"parse"}, {"mutate"},     {"spawn"},   {"generator"},
+    {"extra"}, {"extra_wait"}, {"readback"}};
+
+// mutants handed to AFL++, and test cases that we couldn't parse
+static std::atomic<uint64_t> Mutants(0), Failures(0);
+
+static std::ofstream StatsFile;
+static uint64_t StatsInterval = 5;
+
+class StageTimer {
+  Stage &S;
+  std::chrono::steady_clock::time_point Start;
+
+public:
+  explicit StageTimer(StageId Id)
+      : S(Stages[Id]), Start(std::chrono::steady_clock::now()) {}
+  ~StageTimer() {
+    S.Count++;
+    S.Nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - Start)
+                   .count();
+  }
+};
+
+static void openStats(afl_state_t *afl) {
+  StatsFile.open(std::string((char *)afl->out_dir) + "/fileguide_stats");
+  if (!StatsFile.is_open()) {
+    std::cerr << "ERROR: mutator plugin could not create fileguide_stats\n";
+    exit(-1);
+  }
+  StatsFile << "# relative_time, unix_time, mutants";
+  for (auto &S : Stages)
+    StatsFile << ", " << S.Name << "_count, " << S.Name << "_ms";
+  StatsFile << ", failures, duplicate_mutants, skipped_entries\n";
+}
+
+/*
+ * append a line to fileguide_stats if it's time to (or regardless,
+ * if Force is set)
+ */
+static void writeStats(afl_state_t *afl, bool Force = false) {
+  static uint64_t Last = 0;
+  uint64_t Now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count();
+  if (!Force && Now - Last < StatsInterval * 1000)
+    return;
+  Last = Now;
+  StatsFile << (Now - afl->start_time) / 1000 << ", " << Now / 1000 << ", "
+            << Mutants;
+  for (auto &S : Stages)
+    StatsFile << ", " << S.Count << ", " << S.Nanos / 1000000;
+  StatsFile << ", " << Failures << ", " << DuplicateMutants << ", "
+            << SkippedEntries << std::endl;
+}
+
 static std::string getEnvVar(std::string const &var) {
   char const *val = getenv(var.c_str());
   return (val == nullptr) ? std::string() : std::string(val);
 }
 
+/*
+ * a numeric env var, raised to Min if it's smaller; returns false if
+ * it isn't set, and anything that isn't a number is fatal
+ */
+static bool getEnvNum(std::string const &var, long Min, long &N) {
+  auto Str = getEnvVar(var);
+  if (Str.empty())
+    return false;
+  char *End;
+  errno = 0;
+  N = strtol(Str.c_str(), &End, 10);
+  if (errno != 0 || End == Str.c_str() || *End != '\0') {
+    std::cerr << "\nERROR: Expected a number in env var called " << var
+              << ", got \"" << Str << "\"\n\n";
+    exit(-1);
+  }
+  N = std::max(Min, N);
+  return true;
+}
+
 extern "C" my_mutator *afl_custom_init(afl_state_t *afl, unsigned int seed) {
   mutator::init(seed);
 
   ExtraCommand = getEnvVar("FILEGUIDE_EXTRA_COMMAND");
 
+  long N;
+  if (getEnvNum("FILEGUIDE_FRAGMENTS", 0, N))
+    mutator::set_max_fragments(N);
+
+  if (getEnvNum("FILEGUIDE_FUZZ_COUNT", 1, N))
+    BaseFuzzCount = N;
+
+  long PrefetchThreads = 0, ExtraJobs = 1, ExtraQueue = 0;
+  getEnvNum("FILEGUIDE_PREFETCH", 0, PrefetchThreads);
+  getEnvNum("FILEGUIDE_EXTRA_JOBS", 0, ExtraJobs);
+  if (!getEnvNum("FILEGUIDE_EXTRA_QUEUE", 1, ExtraQueue))
+    ExtraQueue = 2 * ExtraJobs;
+
+  if (getEnvNum("FILEGUIDE_STATS_INTERVAL", 1, N))
+    StatsInterval = N;
+
   Prefix = getEnvVar("FILEGUIDE_COMMENT_PREFIX");
   if (Prefix.empty()) {
     std::cerr << "\nERROR: Expected comment string in env var called "
@@ -71,12 +230,490 @@ extern "C" my_mutator *afl_custom_init(afl_state_t *afl, unsigned int seed) {
     exit(-1);
   }
 
+  startPrefetch(PrefetchThreads);
+
+  if (!ExtraCommand.empty())
+    startCheckers(ExtraJobs, ExtraQueue);
+
   data->afl = afl;
+  openStats(afl);
   return data;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
+/*
+ * the choices saved in a test case, which the generator wrote out
+ * with every value already in range
+ */
+static bool readChoices(const std::string &FileName,
+                        std::vector<tree_guide::rec> &Choices) {
+  std::ifstream Inf(FileName, std::ios::binary);
+  if (!Inf.is_open())
+    return false;
+  std::string Str((std::istreambuf_iterator<char>(Inf)),
+                  std::istreambuf_iterator<char>());
+  StageTimer T(PARSE);
+  return tree_guide::FileGuide::parseChoices(Str.data(), Str.size(), Prefix,
+                                             Choices);
+}
+
+static bool sameChoices(const std::vector<tree_guide::rec> &A,
+                        const std::vector<tree_guide::rec> &B) {
+  if (A.size() != B.size())
+    return false;
+  for (size_t i = 0; i < A.size(); ++i)
+    if (A[i].k != B[i].k || A[i].v != B[i].v)
+      return false;
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * a fresh temporary file; unlike tmpnam(), this is safe to call from
+ * the prefetch workers
+ */
+static std::string tempFile() {
+  char Name[] = "/tmp/fileguide-XXXXXX";
+  int Fd = mkstemp(Name);
+  if (Fd == -1) {
+    perror("mkstemp");
+    exit(-1);
+  }
+  close(Fd);
+  return Name;
+}
+
+static void writeChoices(const std::string &FileName,
+                         const std::vector<tree_guide::rec> &Choices) {
+  std::ofstream Outf(FileName, std::ios::binary);
+  if (!Outf.is_open()) {
+    std::cerr
+        << "ERROR: mutator plugin could not save a file for the generator\n";
+    exit(-1);
+  }
+  Outf << Prefix + tree_guide::StartMarker + "\n";
+  Outf << Prefix;
+  for (auto c : Choices) {
+    switch (c.k) {
+    case tree_guide::RecKind::START:
+      Outf << "{";
+      break;
+    case tree_guide::RecKind::END:
+      Outf << "}";
+      break;
+    case tree_guide::RecKind::NUM:
+      Outf << c.v;
+      break;
+    default:
+      assert(false);
+    }
+    Outf << ",";
+  }
+  Outf << "\n" << Prefix + tree_guide::EndMarker + "\n";
+}
+
+/*
+ * run a program to completion, bailing out if it fails. the child
+ * does nothing but exec, since with prefetching we may be forking a
+ * multithreaded process, whose child can't safely allocate; its
+ * arguments and environment (the plugin's, if envp is null) have to
+ * be set up beforehand
+ */
+static void run(const char *What, StageId Id, char *const argv[],
+                char *const envp[]) {
+  pid_t pid;
+  {
+    StageTimer T(SPAWN);
+    pid = fork();
+  }
+  if (pid == -1) {
+    std::cerr << "ERROR: fork failed\n";
+    exit(-1);
+  }
+  if (pid == 0) {
+    // child: undo the prefetch workers' signal mask, which would
+    // otherwise survive the exec
+    sigset_t None;
+    sigemptyset(&None);
+    sigprocmask(SIG_SETMASK, &None, nullptr);
+    if (envp)
+      execve(argv[0], argv, envp);
+    else
+      execv(argv[0], argv);
+    // of course this line normally does not execute
+    _exit(-1);
+  }
+  int wstatus;
+  {
+    StageTimer T(Id);
+    waitpid(pid, &wstatus, 0);
+  }
+  if (!WIFEXITED(wstatus)) {
+    std::cerr << "ERROR: " << What << " exited abnormally\n";
+    exit(-1);
+  }
+  if (WEXITSTATUS(wstatus) != 0) {
+    std::cerr << "ERROR: " << What << " did not return 0\n";
+    exit(-1);
+  }
+}
+
+/*
+ * AFL++ expects its signals (for timeouts, and so on) to go to the
+ * main thread, so our threads block them
+ */
+static void blockSignals() {
+  sigset_t All;
+  sigfillset(&All);
+  pthread_sigmask(SIG_BLOCK, &All, nullptr);
+}
+
+/*
+ * run the extra command on a file, and then remove it
+ */
+static void check(const std::string &FileName) {
+  // it seems like it would be a nice thing to do to shut down the
+  // shared memory window before we exec the outside code, but
+  // this function invocation crashes, for whatever reason
+  // afl_shm_deinit(&data->afl->shm);
+  char *argv[] = {(char *)ExtraCommand.c_str(), (char *)FileName.c_str(),
+                  nullptr};
+  run("extra command", EXTRA, argv, nullptr);
+  std::remove(FileName.c_str());
+}
+
+/*
+ * CheckerPool: runs the extra command in the background, so that a
+ * slow one doesn't hold up fuzzing. each job is a copy of the
+ * generator's output that belongs to the pool, which removes it once
+ * the command is done with it. there's a fixed number of workers,
+ * and submitting a job waits while the queue of jobs is full, which
+ * keeps the total machine load to a predictable factor
+ */
+class CheckerPool {
+  std::mutex M;
+  std::condition_variable Work, Space;
+  std::vector<std::thread> Workers;
+  std::deque<std::string> Jobs;
+  const size_t Capacity;
+  bool Stop = false;
+
+  void work();
+
+public:
+  CheckerPool(unsigned Threads, size_t _Capacity);
+  void submit(const std::string &FileName);
+  /*
+   * finish the jobs that are already queued, then shut down
+   */
+  void stop();
+};
+
+CheckerPool::CheckerPool(unsigned Threads, size_t _Capacity)
+    : Capacity(_Capacity) {
+  for (unsigned T = 0; T < Threads; ++T)
+    Workers.emplace_back([this] { work(); });
+}
+
+void CheckerPool::submit(const std::string &FileName) {
+  StageTimer T(EXTRA_WAIT);
+  std::unique_lock<std::mutex> L(M);
+  Space.wait(L, [this] { return Jobs.size() < Capacity; });
+  Jobs.push_back(FileName);
+  Work.notify_one();
+}
+
+void CheckerPool::work() {
+  blockSignals();
+  for (;;) {
+    std::string FileName;
+    {
+      std::unique_lock<std::mutex> L(M);
+      Work.wait(L, [this] { return Stop || !Jobs.empty(); });
+      if (Jobs.empty())
+        return;
+      FileName = std::move(Jobs.front());
+      Jobs.pop_front();
+      Space.notify_one();
+    }
+    check(FileName);
+  }
+}
+
+void CheckerPool::stop() {
+  {
+    std::lock_guard<std::mutex> L(M);
+    Stop = true;
+    Work.notify_all();
+  }
+  for (auto &T : Workers)
+    T.join();
+  Workers.clear();
+}
+
+static void startCheckers(unsigned Threads, size_t Capacity) {
+  if (Threads > 0)
+    Checkers = new CheckerPool(Threads, Capacity);
+}
+
+/*
+ * run the generator on a sequence of choices, returning the test
+ * case that it wrote, cut off at MAX_FILE bytes, and hand that to
+ * the extra command (if any)
+ */
+static std::string generate(const std::vector<tree_guide::rec> &Choices) {
+  auto InFn = tempFile(), OutFn = tempFile();
+  writeChoices(InFn, Choices);
+
+  auto Env1 = "FILEGUIDE_INPUT_FILE=" + InFn;
+  auto Env2 = "FILEGUIDE_OUTPUT_FILE=" + OutFn;
+  char *argv[] = {(char *)Generator.c_str(), nullptr};
+  char *envp[] = {(char *)Env1.c_str(), (char *)Env2.c_str(), nullptr};
+  if (DEBUG_PLUGIN)
+    std::cerr << Env1 << " " << Env2 << "\n";
+  run("generator", GENERATOR, argv, envp);
+
+  std::string Out;
+  {
+    StageTimer T(READBACK);
+    std::ifstream Inf(OutFn, std::ios::binary);
+    if (!Inf.is_open()) {
+      std::cerr << "ERROR: mutator plugin could not load file written by the "
+                   "generator\n";
+      exit(-1);
+    }
+    Out.assign(std::istreambuf_iterator<char>(Inf),
+               std::istreambuf_iterator<char>());
+    if (Out.size() > MAX_FILE)
+      Out.resize(MAX_FILE);
+  }
+
+  std::remove(InFn.c_str());
+  // the extra command gets the output file, which it's then
+  // responsible for removing
+  if (Checkers)
+    Checkers->submit(OutFn);
+  else if (!ExtraCommand.empty())
+    check(OutFn);
+  else
+    std::remove(OutFn.c_str());
+  return Out;
+}
+
+/*
+ * Prefetcher: background workers that mutate the current queue entry
+ * and run the generator on the result, so that the generator runs
+ * while AFL++ is running the target on earlier mutants. the workers
+ * keep a bounded queue of finished mutants, topped up until it holds
+ * as many as AFL++ will still ask for from this entry (if we know
+ * that); when AFL++ moves on to another entry, the leftovers are
+ * dropped. a mutant that is an empty string is one that had the same
+ * choices as its parent
+ */
+class Prefetcher {
+  std::mutex M;
+  std::condition_variable Ready, Space;
+  std::vector<std::thread> Workers;
+  std::deque<std::string> Queue;
+  const size_t Capacity;
+  std::vector<tree_guide::rec> Parent;
+  // bumped whenever the parent changes, so that workers can tell
+  // whether what they made is still wanted
+  uint64_t Epoch = 0;
+  uint64_t Budget = 0, InFlight = 0;
+  bool Stop = false;
+
+  void work();
+  bool wanted() const {
+    return Queue.size() + InFlight < std::min<uint64_t>(Capacity, Budget);
+  }
+
+public:
+  Prefetcher(unsigned Threads, size_t _Capacity);
+  /*
+   * start making Count mutants of a queue entry
+   */
+  void restart(const std::vector<tree_guide::rec> &Choices, uint64_t Count);
+  /*
+   * the next mutant of a queue entry, waiting for it if necessary
+   */
+  std::string next(const std::vector<tree_guide::rec> &Choices);
+  void stop();
+};
+
+Prefetcher::Prefetcher(unsigned Threads, size_t _Capacity)
+    : Capacity(_Capacity) {
+  for (unsigned T = 0; T < Threads; ++T)
+    Workers.emplace_back([this] { work(); });
+}
+
+void Prefetcher::restart(const std::vector<tree_guide::rec> &Choices,
+                         uint64_t Count) {
+  std::lock_guard<std::mutex> L(M);
+  Parent = Choices;
+  Budget = Count;
+  ++Epoch;
+  Queue.clear();
+  Space.notify_all();
+}
+
+std::string Prefetcher::next(const std::vector<tree_guide::rec> &Choices) {
+  // without a mutant count from AFL++, keep the queue full
+  if (!sameChoices(Choices, Parent))
+    restart(Choices, UINT64_MAX);
+  std::unique_lock<std::mutex> L(M);
+  // AFL++ wants more mutants than it said it would
+  if (Budget == 0)
+    Budget = 1;
+  Space.notify_all();
+  Ready.wait(L, [this] { return !Queue.empty(); });
+  auto Out = std::move(Queue.front());
+  Queue.pop_front();
+  if (Budget != UINT64_MAX)
+    --Budget;
+  Space.notify_one();
+  return Out;
+}
+
+void Prefetcher::work() {
+  blockSignals();
+  for (;;) {
+    std::vector<tree_guide::rec> C;
+    uint64_t E;
+    bool Same;
+    {
+      std::unique_lock<std::mutex> L(M);
+      Space.wait(L, [this] { return Stop || wanted(); });
+      if (Stop)
+        return;
+      C = Parent;
+      E = Epoch;
+      ++InFlight;
+      // mutating also has to happen while the parent can't change
+      StageTimer T(MUTATE);
+      mutator::mutate_choices(C);
+      Same = sameChoices(C, Parent);
+    }
+    std::string Out;
+    if (Same)
+      ++DuplicateMutants;
+    else
+      Out = generate(C);
+    std::lock_guard<std::mutex> L(M);
+    --InFlight;
+    if (E == Epoch) {
+      Queue.push_back(std::move(Out));
+      Ready.notify_one();
+    } else {
+      Space.notify_one();
+    }
+  }
+}
+
+void Prefetcher::stop() {
+  {
+    std::lock_guard<std::mutex> L(M);
+    Stop = true;
+    Space.notify_all();
+  }
+  for (auto &T : Workers)
+    T.join();
+  Workers.clear();
+}
+
+static void startPrefetch(unsigned Threads) {
+  if (Threads > 0)
+    Prefetch = new Prefetcher(Threads, 2 * Threads);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Decide whether a queue entry gets fuzzed
+ *
+ * @param[in] data pointer returned in afl_custom_init for this fuzz case
+ * @param[in] filename File name of the queue entry
+ * @return 0 to skip the entry, anything else to fuzz it
+ */
+extern "C" uint8_t afl_custom_queue_get(my_mutator *data,
+                                        const uint8_t *filename) {
+  std::string FileName((const char *)filename);
+  std::vector<tree_guide::rec> Choices;
+  // let AFL++ deal with anything that we can't make sense of
+  if (!readChoices(FileName, Choices)) {
+    ++Failures;
+    return 1;
+  }
+  // the mutator indexes the paths of every queue entry and mutant
+  // that we've seen
+  auto Id = mutator::find_path(Choices);
+  if (!Id)
+    Id = mutator::add_path(Choices).first;
+  auto It = Representative.find(*Id);
+  if (It == Representative.end()) {
+    Representative.emplace(*Id, FileName);
+    // a new path, whose scopes and values the mutator can reuse
+    mutator::add_fragments(Choices);
+    mutator::add_values(Choices);
+    return 1;
+  }
+  if (It->second == FileName)
+    return 1;
+  ++SkippedEntries;
+  if (DEBUG_PLUGIN)
+    std::cerr << "skipping " << FileName << ", it has the same path as "
+              << It->second << " (" << SkippedEntries << " skipped)\n";
+  return 0;
+}
+
+/**
+ * Decide how many mutants to make from a queue entry
+ *
+ * our mutator changes values at randomly chosen points along the
+ * entry's path, so we give an entry mutants in proportion to the
+ * path's mean novelty: the chance that a different choice at a random
+ * point along it goes somewhere that we've not seen yet. this is
+ * relative to the average over the entries seen so far, and clamped
+ * to within a factor of 8 of the base count
+ *
+ * @param[in] data pointer returned in afl_custom_init for this fuzz case
+ * @param[in] buf Buffer containing the queue entry
+ * @param[in] buf_size Size of the queue entry
+ * @return The number of mutants to make
+ */
+extern "C" uint32_t afl_custom_fuzz_count(my_mutator *data, const uint8_t *buf,
+                                          size_t buf_size) {
+  std::vector<tree_guide::rec> Choices;
+  bool Parsed;
+  {
+    StageTimer T(PARSE);
+    Parsed = tree_guide::FileGuide::parseChoices((const char *)buf, buf_size,
+                                                 Prefix, Choices);
+  }
+  if (!Parsed) {
+    ++Failures;
+    return BaseFuzzCount;
+  }
+  auto Novelty = mutator::path_novelty(Choices);
+  NoveltyTotal += Novelty;
+  NoveltyCount++;
+  auto Mean = NoveltyTotal / NoveltyCount;
+  double Scale = Mean > 0.0 ? Novelty / Mean : 1.0;
+  Scale = std::min(8.0, std::max(1.0 / 8.0, Scale));
+  uint32_t Count = std::max(1.0, BaseFuzzCount * Scale);
+  if (DEBUG_PLUGIN)
+    std::cerr << "novelty " << Novelty << " (mean " << Mean << "), making "
+              << Count << " mutants\n";
+  // get the workers going before AFL++ asks for the first one
+  if (Prefetch)
+    Prefetch->restart(Choices, Count);
+  return Count;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 /**
  * Perform custom mutations on a given input
  *
@@ -98,153 +735,85 @@ extern "C" size_t afl_custom_fuzz(my_mutator *data, uint8_t *buf,
                                   uint8_t *add_buf,
                                   size_t add_buf_size, // add_buf can be NULL
                                   size_t max_size) {
+  // even an empty mutant needs a buffer: AFL++ takes a null one to
+  // mean that the mutator failed, and gives up on this queue entry
+  *out_buf = data->mutated_out;
+  writeStats(data->afl);
   std::string Str((char *)buf, buf_size);
   std::stringstream SS(Str);
   tree_guide::FileGuide FG;
   //FG.setSync(tree_guide::Sync::RESYNC);
   FG.setSync(tree_guide::Sync::NONE);
-  if (!FG.parseChoices(SS, Prefix)) {
+  bool Parsed;
+  {
+    StageTimer T(PARSE);
+    Parsed = FG.parseChoices(SS, Prefix);
+  }
+  if (!Parsed) {
     std::cerr << "ERROR: couldn't parse choices from:\n";
     std::cerr << SS.str();
     std::cerr << "--------------------------\n\n";
     exit(-1);
   }
-  auto C1 = FG.getChoices();
+  // the queue entry was written by the generator, so these are the
+  // canonical choices for its path
+  const auto Parent = FG.getChoices();
   if (DEBUG_PLUGIN)
-    std::cerr << "parsed " << C1.size() << " choices\n";
-  mutator::mutate_choices(C1);
-  if (DEBUG_PLUGIN)
-    std::cerr << "mutated\n";
-  FG.replaceChoices(C1);
-
-  tree_guide::SaverGuide SG(&FG, Prefix);
-  auto Ch = SG.makeChooser();
-  auto Ch2 = static_cast<tree_guide::SaverChooser *>(Ch.get());
-  assert(Ch2);
-
-  std::string InFn(std::tmpnam(nullptr));
-  std::string OutFn(std::tmpnam(nullptr));
-
-  {
-    std::ofstream Outf(InFn, std::ios::binary);
-    if (!Outf.is_open()) {
-      std::cerr
-          << "ERROR: mutator plugin could not save a file for the generator\n";
-      exit(-1);
-    }
-    Outf << Prefix + tree_guide::StartMarker + "\n";
-    Outf << Prefix;
-    for (auto c : C1) {
-      switch (c.k) {
-      case tree_guide::RecKind::START:
-        Outf << "{";
-        break;
-      case tree_guide::RecKind::END:
-        Outf << "}";
-        break;
-      case tree_guide::RecKind::NUM:
-        Outf << c.v;
-        break;
-      default:
-        assert(false);
-      }
-      Outf << ",";
-    }
-    Outf << "\n" << Prefix + tree_guide::EndMarker + "\n";
-    Outf.close();
-  }
-
-  auto pid1 = fork();
-  if (pid1 == -1) {
-    std::cerr << "ERROR: fork failed\n";
-    exit(-1);
-  }
-  if (pid1 == 0) {
-    // child
-    char *argv[] = {(char *)Generator.c_str(), nullptr};
-    auto env1 = "FILEGUIDE_INPUT_FILE=" + InFn;
-    auto env2 = "FILEGUIDE_OUTPUT_FILE=" + OutFn;
-    char *envp[] = {(char *)env1.c_str(), (char *)env2.c_str(), nullptr};
-    if (DEBUG_PLUGIN) {
-      for (int i = 0; envp[i] != nullptr; ++i)
-        std::cerr << envp[i] << " ";
-      std::cerr << "\n";
-    }
-    auto res = execve(Generator.c_str(), argv, envp);
-    // of course this line normally does not execute
-    exit(res);
-  }
-
-  // parent
-  int wstatus;
-  waitpid(pid1, &wstatus, 0);
-  if (!WIFEXITED(wstatus)) {
-    std::cerr << "ERROR: child exited abnormally\n";
-    exit(-1);
-  }
-  auto ret = WEXITSTATUS(wstatus);
-  if (ret != 0) {
-    std::cerr << "ERROR: child did not return 0\n";
-    exit(-1);
-  }
-
-  if (!ExtraCommand.empty()) {
-    auto pid2 = fork();
-    if (pid2 == -1) {
-      std::cerr << "ERROR: fork failed\n";
-      exit(-1);
+    std::cerr << "parsed " << Parent.size() << " choices\n";
+
+  std::string Out;
+  if (Prefetch) {
+    Out = Prefetch->next(Parent);
+  } else {
+    auto C1 = Parent;
+    {
+      StageTimer T(MUTATE);
+      mutator::mutate_choices(C1);
     }
-    if (pid2 == 0) {
-      // child
-
-      // it seems like it would be a nice thing to do to shut down the
-      // shared memory window before we exec the outside code, but
-      // this function invocation crashes, for whatever reason
-      // afl_shm_deinit(&data->afl->shm);
-
-      auto res = execl(ExtraCommand.c_str(), ExtraCommand.c_str(), OutFn.c_str(), (char *)nullptr);
-      // of course this line normally does not execute
-      exit(res);
-    }
-    // wait for the child process -- this keeps total machine load to
-    // a predictable factor and also prevents the plugin from removing
-    // the temp file while the second child is still looking at it
-    int wstatus;
-    waitpid(pid2, &wstatus, 0);
-    if (!WIFEXITED(wstatus)) {
-      std::cerr << "ERROR: child2 exited abnormally\n";
-      exit(-1);
-    }
-    auto ret = WEXITSTATUS(wstatus);
-    if (ret != 0) {
-      std::cerr << "ERROR: child2 did not return 0\n";
-      exit(-1);
+    if (DEBUG_PLUGIN)
+      std::cerr << "mutated\n";
+    // returning nothing tells AFL++ not to bother running the target
+    if (sameChoices(C1, Parent)) {
+      ++DuplicateMutants;
+      return 0;
     }
+    Out = generate(C1);
   }
-
-  std::streamsize amount;
+  // an empty mutant is one that isn't worth running
+  if (Out.empty())
+    return 0;
+  memcpy(data->mutated_out, Out.data(), Out.size());
+  size_t amount = Out.size();
+
+  // the generator wrote out the choices that it actually made: values
+  // reduced to range, without any that it didn't use. if that's a path
+  // that we've seen before (most likely the parent's), the target
+  // would just be doing the same thing again
   {
-    std::ifstream Inf(OutFn, std::ios::binary);
-    if (!Inf.is_open()) {
-      std::cerr << "ERROR: mutator plugin could not load file written by the "
-                   "generator\n";
-      exit(-1);
+    std::vector<tree_guide::rec> Mutant;
+    {
+      StageTimer T(PARSE);
+      Parsed = tree_guide::FileGuide::parseChoices(
+          (const char *)data->mutated_out, amount, Prefix, Mutant);
+    }
+    if (!Parsed)
+      ++Failures;
+    else if (!mutator::add_path(Mutant).second) {
+      ++DuplicateMutants;
+      if (DEBUG_PLUGIN)
+        std::cerr << "mutant has a known path (" << DuplicateMutants
+                  << " so far)\n";
+      return 0;
     }
-    Inf.read((char *)data->mutated_out, MAX_FILE);
-    amount = Inf.gcount();
-    Inf.close();
   }
 
-  std::remove(InFn.c_str());
-  std::remove(OutFn.c_str());
-
   if (DEBUG_PLUGIN) {
     std::cerr << "buffer:\n";
     std::cerr << (char *)data->mutated_out;
     std::cerr << "\n\n";
   }
 
-  *out_buf = data->mutated_out;
+  ++Mutants;
   // return strlen((char *)data->mutated_out);
   return amount;
 }
@@ -275,6 +844,18 @@ extern "C" uint8_t afl_custom_havoc_mutation_probability(my_mutator *data) {
 }
 
 extern "C" void afl_custom_deinit(my_mutator *data) {
+  if (Prefetch) {
+    Prefetch->stop();
+    delete Prefetch;
+    Prefetch = nullptr;
+  }
+  if (Checkers) {
+    Checkers->stop();
+    delete Checkers;
+    Checkers = nullptr;
+  }
+  writeStats(data->afl, true);
+  StatsFile.close();
   free(data->post_process_buf);
   free(data->mutated_out);
   free(data->trim_buf);
@@ -0,0 +1,357 @@
+#ifndef TREE_GUIDE_CORPUS_STORE_H_
+#define TREE_GUIDE_CORPUS_STORE_H_
+
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "guide.h"
+
+namespace tree_guide {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * CorpusStore: a content-addressed store of choice sequences, meant
+ * to replace directories full of small files in SaverGuide's text
+ * format. a store named P is two files:
+ *
+ *   P.pack  records, one per distinct sequence, in append order
+ *   P.idx   one fixed-size entry per record: the 128-bit hash of the
+ *           sequence and the record's offset in the packfile
+ *
+ * sequences are deduplicated by hash. a record either spells out its
+ * sequence or refers back to an earlier record that it shares a
+ * prefix with, storing only the length of the shared prefix and the
+ * rest of the sequence. the base is the best match among recently
+ * appended records, and chains of bases are limited in length so
+ * that decoding stays cheap. everything is varint-encoded; a choice
+ * is a single token:
+ *
+ *   0        START (beginning of a scope)
+ *   1        END
+ *   2 V      NUM with value V, for values too large for the next case
+ *   V + 3    NUM with value V
+ *
+ * and a record is:
+ *
+ *   BaseDistance [SharedLength] Count Token...
+ *
+ * where BaseDistance is zero for a record without a base, and
+ * otherwise the distance back to its base in bytes. the index is the
+ * source of truth, so a record whose index entry never made it to
+ * disk is ignored. reading is done through a memory map of the
+ * packfile, which is grown as records are appended
+ */
+
+class CorpusStore {
+  struct IndexEntry {
+    uint64_t Lo, Hi;
+    // the offset in the low 56 bits, chain depth in the high 8
+    uint64_t OffsetAndDepth;
+  };
+  static const int DepthShift = 56;
+
+  std::string PackName, IdxName;
+  int PackFd = -1, IdxFd = -1;
+  const uint8_t *Map = nullptr;
+  uint64_t MapSize = 0, PackSize = 0;
+  const uint64_t MaxChain;
+  std::vector<IndexEntry> Index;
+  std::unordered_multimap<uint64_t, uint64_t> ByHash;
+  // candidate bases for new records: (index entry, decoded sequence)
+  std::deque<std::pair<uint64_t, std::vector<rec>>> Recent;
+  static const size_t RecentWindow = 32;
+  // records without a base are kept as candidates for longer, so
+  // that a run of variants on one sequence doesn't end up with every
+  // candidate at the maximum chain length
+  static const size_t RecentFull = 8;
+
+  [[noreturn]] inline static void fatal(const std::string &);
+  inline static void putVarint(std::vector<uint8_t> &, uint64_t);
+  inline uint64_t getVarint(uint64_t &Pos);
+  inline void remap();
+  inline uint64_t decode(uint64_t Offset, std::vector<rec> &Out);
+  inline std::optional<uint64_t> find(const PathHash &);
+  inline void remember(uint64_t Entry, const std::vector<rec> &);
+
+public:
+  inline CorpusStore(const std::string &Path, uint64_t _MaxChain = 16);
+  inline ~CorpusStore();
+  CorpusStore(const CorpusStore &) = delete;
+  CorpusStore &operator=(const CorpusStore &) = delete;
+  inline static PathHash hashOf(const std::vector<rec> &);
+  // returns false if the sequence was already stored
+  inline bool append(const std::vector<rec> &Choices);
+  inline bool contains(const PathHash &H) { return find(H).has_value(); }
+  inline std::optional<std::vector<rec>> lookup(const PathHash &H);
+  // visit every sequence in the order in which it was appended
+  inline void forEach(
+      const std::function<void(const PathHash &, const std::vector<rec> &)> &);
+  inline uint64_t size() { return Index.size(); }
+  inline uint64_t packBytes() { return PackSize; }
+};
+
+void CorpusStore::fatal(const std::string &Msg) {
+  std::cerr << "FATAL ERROR: " << Msg << "\n\n";
+  exit(-1);
+}
+
+void CorpusStore::putVarint(std::vector<uint8_t> &Out, uint64_t V) {
+  while (V >= 0x80) {
+    Out.push_back((V & 0x7f) | 0x80);
+    V >>= 7;
+  }
+  Out.push_back(V);
+}
+
+uint64_t CorpusStore::getVarint(uint64_t &Pos) {
+  uint64_t V = 0;
+  for (int Shift = 0;; Shift += 7) {
+    if (Pos >= PackSize || Shift > 63)
+      fatal("Corrupt corpus packfile " + PackName);
+    uint8_t B = Map[Pos++];
+    V |= (uint64_t)(B & 0x7f) << Shift;
+    if (!(B & 0x80))
+      return V;
+  }
+}
+
+PathHash CorpusStore::hashOf(const std::vector<rec> &Choices) {
+  PathHash H;
+  for (auto &R : Choices)
+    H.add((uint64_t)R.k, R.v);
+  return H;
+}
+
+CorpusStore::CorpusStore(const std::string &Path, uint64_t _MaxChain)
+    : PackName(Path + ".pack"), IdxName(Path + ".idx"), MaxChain(_MaxChain) {
+  PackFd = open(PackName.c_str(), O_RDWR | O_CREAT, 0644);
+  IdxFd = open(IdxName.c_str(), O_RDWR | O_CREAT, 0644);
+  if (PackFd == -1 || IdxFd == -1)
+    fatal("Can't open corpus store " + Path);
+  struct stat St;
+  if (fstat(IdxFd, &St) != 0)
+    fatal("Can't stat " + IdxName);
+  // a partially written trailing entry is ignored
+  Index.resize(St.st_size / sizeof(IndexEntry));
+  if (!Index.empty() &&
+      pread(IdxFd, Index.data(), Index.size() * sizeof(IndexEntry), 0) !=
+          (ssize_t)(Index.size() * sizeof(IndexEntry)))
+    fatal("Can't read " + IdxName);
+  if (ftruncate(IdxFd, Index.size() * sizeof(IndexEntry)) != 0)
+    fatal("Can't truncate " + IdxName);
+  for (uint64_t i = 0; i < Index.size(); ++i)
+    ByHash.emplace(Index.at(i).Lo, i);
+  if (fstat(PackFd, &St) != 0)
+    fatal("Can't stat " + PackName);
+  PackSize = St.st_size;
+  remap();
+  // records without an index entry are dropped, and everything
+  // appended from here on goes after the last indexed record
+  uint64_t End = 0;
+  if (!Index.empty()) {
+    End = Index.back().OffsetAndDepth & ((1ULL << DepthShift) - 1);
+    std::vector<rec> Last;
+    End = decode(End, Last);
+    remember(Index.size() - 1, Last);
+  }
+  if (End < PackSize) {
+    if (ftruncate(PackFd, End) != 0)
+      fatal("Can't truncate " + PackName);
+    PackSize = End;
+    remap();
+  }
+}
+
+CorpusStore::~CorpusStore() {
+  if (Map)
+    munmap((void *)Map, MapSize);
+  close(PackFd);
+  close(IdxFd);
+}
+
+/*
+ * map the whole packfile, with some room to spare so that we don't
+ * have to do this after every append
+ */
+void CorpusStore::remap() {
+  if (Map && PackSize <= MapSize)
+    return;
+  if (Map)
+    munmap((void *)Map, MapSize);
+  Map = nullptr;
+  MapSize = 0;
+  if (PackSize == 0)
+    return;
+  uint64_t Size = std::max(PackSize * 2, (uint64_t)1 << 20);
+  void *P = mmap(nullptr, Size, PROT_READ, MAP_SHARED, PackFd, 0);
+  if (P == MAP_FAILED)
+    fatal("Can't map " + PackName);
+  Map = static_cast<const uint8_t *>(P);
+  MapSize = Size;
+}
+
+/*
+ * decode the record at Offset, returning the offset just past it
+ */
+uint64_t CorpusStore::decode(uint64_t Offset, std::vector<rec> &Out) {
+  uint64_t Pos = Offset;
+  auto BaseDistance = getVarint(Pos);
+  Out.clear();
+  if (BaseDistance != 0) {
+    auto Shared = getVarint(Pos);
+    if (BaseDistance > Offset)
+      fatal("Corrupt corpus packfile " + PackName);
+    decode(Offset - BaseDistance, Out);
+    if (Shared > Out.size())
+      fatal("Corrupt corpus packfile " + PackName);
+    Out.resize(Shared);
+  }
+  auto Count = getVarint(Pos);
+  for (uint64_t i = 0; i < Count; ++i) {
+    auto T = getVarint(Pos);
+    if (T == 0)
+      Out.push_back({RecKind::START, 0});
+    else if (T == 1)
+      Out.push_back({RecKind::END, 0});
+    else if (T == 2)
+      Out.push_back({RecKind::NUM, getVarint(Pos)});
+    else
+      Out.push_back({RecKind::NUM, T - 3});
+  }
+  return Pos;
+}
+
+std::optional<uint64_t> CorpusStore::find(const PathHash &H) {
+  auto [Begin, End] = ByHash.equal_range(H.Lo);
+  for (auto It = Begin; It != End; ++It)
+    if (Index.at(It->second).Hi == H.Hi)
+      return It->second;
+  return {};
+}
+
+void CorpusStore::remember(uint64_t Entry, const std::vector<rec> &Choices) {
+  Recent.emplace_back(Entry, Choices);
+  if (Recent.size() <= RecentWindow)
+    return;
+  size_t Full = 0;
+  for (auto &R : Recent)
+    Full += (Index.at(R.first).OffsetAndDepth >> DepthShift) == 0;
+  for (auto It = Recent.begin(); It != Recent.end(); ++It) {
+    if (Full > RecentFull ||
+        (Index.at(It->first).OffsetAndDepth >> DepthShift) != 0) {
+      Recent.erase(It);
+      return;
+    }
+  }
+}
+
+bool CorpusStore::append(const std::vector<rec> &Choices) {
+  auto H = hashOf(Choices);
+  if (find(H))
+    return false;
+
+  // pick the recent record that shares the longest prefix with us
+  uint64_t BestShared = 0, BestEntry = 0;
+  for (auto &[Entry, Seq] : Recent) {
+    auto Depth = Index.at(Entry).OffsetAndDepth >> DepthShift;
+    if (Depth >= MaxChain)
+      continue;
+    uint64_t Shared = 0;
+    while (Shared < Seq.size() && Shared < Choices.size() &&
+           Seq.at(Shared).k == Choices.at(Shared).k &&
+           Seq.at(Shared).v == Choices.at(Shared).v)
+      ++Shared;
+    // on a tie, prefer the shorter chain
+    if (Shared > BestShared ||
+        (Shared == BestShared && Shared > 0 &&
+         Depth < (Index.at(BestEntry).OffsetAndDepth >> DepthShift))) {
+      BestShared = Shared;
+      BestEntry = Entry;
+    }
+  }
+  // referring back to a base costs a few bytes, so only bother when
+  // it saves something
+  uint64_t Depth = 0;
+  std::vector<uint8_t> Buf;
+  if (BestShared >= 4) {
+    auto Base = Index.at(BestEntry).OffsetAndDepth;
+    Depth = (Base >> DepthShift) + 1;
+    putVarint(Buf, PackSize - (Base & ((1ULL << DepthShift) - 1)));
+    putVarint(Buf, BestShared);
+  } else {
+    BestShared = 0;
+    putVarint(Buf, 0);
+  }
+  putVarint(Buf, Choices.size() - BestShared);
+  for (uint64_t i = BestShared; i < Choices.size(); ++i) {
+    auto &R = Choices.at(i);
+    switch (R.k) {
+    case RecKind::START:
+      putVarint(Buf, 0);
+      break;
+    case RecKind::END:
+      putVarint(Buf, 1);
+      break;
+    case RecKind::NUM:
+      if (R.v >= (uint64_t)-3) {
+        putVarint(Buf, 2);
+        putVarint(Buf, R.v);
+      } else {
+        putVarint(Buf, R.v + 3);
+      }
+      break;
+    default:
+      assert(false);
+    }
+  }
+
+  if (pwrite(PackFd, Buf.data(), Buf.size(), PackSize) != (ssize_t)Buf.size())
+    fatal("Can't write " + PackName);
+  IndexEntry E{H.Lo, H.Hi, PackSize | (Depth << DepthShift)};
+  if (pwrite(IdxFd, &E, sizeof(E), Index.size() * sizeof(IndexEntry)) !=
+      (ssize_t)sizeof(E))
+    fatal("Can't write " + IdxName);
+  PackSize += Buf.size();
+  Index.push_back(E);
+  ByHash.emplace(H.Lo, Index.size() - 1);
+  remember(Index.size() - 1, Choices);
+  return true;
+}
+
+std::optional<std::vector<rec>> CorpusStore::lookup(const PathHash &H) {
+  auto Entry = find(H);
+  if (!Entry)
+    return {};
+  remap();
+  std::vector<rec> Choices;
+  decode(Index.at(*Entry).OffsetAndDepth & ((1ULL << DepthShift) - 1),
+         Choices);
+  return Choices;
+}
+
+void CorpusStore::forEach(
+    const std::function<void(const PathHash &, const std::vector<rec> &)> &F) {
+  remap();
+  std::vector<rec> Choices;
+  for (auto &E : Index) {
+    decode(E.OffsetAndDepth & ((1ULL << DepthShift) - 1), Choices);
+    F({E.Lo, E.Hi}, Choices);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace tree_guide
+
+#endif
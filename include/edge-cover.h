@@ -0,0 +1,113 @@
+#ifndef TREE_GUIDE_EDGE_COVER_H_
+#define TREE_GUIDE_EDGE_COVER_H_
+
+#include <algorithm>
+#include <queue>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+#include "guide.h"
+
+namespace tree_guide {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * decision-tree coverage for saved choice sequences, for distilling a
+ * corpus without running the target (see aflplusplus/guide-cmin.cpp).
+ * a sequence covers an edge (node, branch) for each choice that it
+ * made, where the branch is the value chosen and the node stands for
+ * where in the generator the choice was made. the full path up to a
+ * choice would identify its node exactly, but then no two distinct
+ * paths could have the same coverage. so, much as AFL++ identifies an
+ * edge by its last couple of basic blocks, a node is identified by
+ * the last K values before the choice, along with the scopes entered
+ * and left among them
+ */
+
+/*
+ * the edges covered by a sequence of choices, with K values of
+ * context, sorted and deduplicated. a sequence without any values
+ * still took a path, the one that makes no choices, so it covers an
+ * edge of its own
+ */
+inline std::vector<uint64_t> contextEdges(const std::vector<rec> &Choices,
+                                          unsigned K) {
+  const uint64_t Start = 0x9e3779b97f4a7c15ULL;
+  std::vector<uint64_t> Result;
+  // the most recent tokens, as in CorpusStore: 0 and 1 for entering
+  // and leaving a scope, and values offset by 2. scope tokens don't
+  // count towards K
+  std::vector<uint64_t> Context;
+  unsigned Values = 0;
+  for (auto &R : Choices) {
+    if (R.k != RecKind::NUM) {
+      Context.push_back(R.k == RecKind::START ? 0 : 1);
+      continue;
+    }
+    uint64_t Node = Start;
+    for (auto T : Context)
+      Node = mix64(Node ^ mix64(T));
+    Result.push_back(mix64(Node ^ mix64(R.v + 2)));
+    Context.push_back(R.v + 2);
+    if (++Values > K) {
+      // drop everything up to and including the oldest value
+      auto It = std::find_if(Context.begin(), Context.end(),
+                             [](uint64_t T) { return T > 1; });
+      Context.erase(Context.begin(), It + 1);
+      --Values;
+    }
+  }
+  if (Result.empty())
+    Result.push_back(mix64(Start));
+  std::sort(Result.begin(), Result.end());
+  Result.erase(std::unique(Result.begin(), Result.end()), Result.end());
+  return Result;
+}
+
+/*
+ * greedy set cover: over and over, take the item that covers the most
+ * edges that aren't covered yet, preferring smaller items. made fast
+ * by updating an item's count of new edges only when it gets to the
+ * front of the queue: counts only go down, so if the updated count
+ * still beats everything else in the queue, it's the best choice.
+ * Edges has each item's edges, sorted and deduplicated; returns the
+ * indices of the chosen items, in the order they were chosen
+ */
+inline std::vector<size_t>
+greedyCover(const std::vector<std::vector<uint64_t>> &Edges,
+            const std::vector<uint64_t> &Sizes, uint64_t &CoveredEdges) {
+  // (new edges, -size, -index)
+  using Entry = std::tuple<uint64_t, int64_t, int64_t>;
+  std::priority_queue<Entry> Queue;
+  for (size_t I = 0; I < Edges.size(); ++I)
+    if (!Edges[I].empty())
+      Queue.push({Edges[I].size(), -(int64_t)Sizes.at(I), -(int64_t)I});
+  std::unordered_set<uint64_t> Covered;
+  std::vector<size_t> Chosen;
+  while (!Queue.empty()) {
+    auto [Old, NegSize, NegI] = Queue.top();
+    Queue.pop();
+    auto &E = Edges[-NegI];
+    uint64_t New = 0;
+    for (auto X : E)
+      New += !Covered.count(X);
+    if (New == 0)
+      continue;
+    if (New < Old) {
+      Queue.push({New, NegSize, NegI});
+      continue;
+    }
+    Covered.insert(E.begin(), E.end());
+    Chosen.push_back(-NegI);
+  }
+  CoveredEdges = Covered.size();
+  return Chosen;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace tree_guide
+
+#endif
@@ -0,0 +1,394 @@
+#ifndef TREE_GUIDE_FORK_RUNNER_H_
+#define TREE_GUIDE_FORK_RUNNER_H_
+
+#ifdef __linux__
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "guide.h"
+
+namespace tree_guide {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * ForkRunner: for generators that do a lot of expensive work before
+ * they get to the interesting decisions. instead of re-executing the
+ * shared prefix for every leaf, each call to run() forks a prefix
+ * process that runs the generator for the first ForkDepth branching
+ * choices (as decided by a guide for the prefix), and then forks a
+ * copy-on-write child for each suffix below that point (as decided by
+ * a fresh guide for the suffixes of that prefix). the prefix is
+ * computed once and shared by up to MaxSuffixes leaves.
+ *
+ * a guide can't be shared between processes, so each process works
+ * on its own copy and, when it is done, streams a log of the calls
+ * that it made back to its parent. the parent replays the log into
+ * its own copy of the chooser, which (since guides and generators are
+ * deterministic given their state) leaves the parent's guide in the
+ * same state as if the traversal had happened in-process. children
+ * are run one at a time, since each suffix depends on what the
+ * previous ones found.
+ *
+ * the generator is run only in child processes, so its output has to
+ * go somewhere other than the caller's memory: a file, a pipe, shared
+ * memory, or the test harness being driven. a suffix that crashes
+ * ends the exploration of its prefix, since its traversal can't be
+ * replayed.
+ *
+ * this is Linux-only.
+ */
+
+enum class CallKind : uint64_t {
+  CHOOSE = 555,
+  WEIGHTED_DOUBLE,
+  WEIGHTED_UINT,
+  UNIMPORTANT,
+  BEGIN_SCOPE,
+  END_SCOPE
+};
+
+class ForkChooser;
+
+class ForkRunner {
+  friend ForkChooser;
+  Guide &PrefixG;
+  std::function<std::unique_ptr<Guide>()> MakeSuffixGuide;
+  const uint64_t ForkDepth, MaxSuffixes;
+  uint64_t Prefixes = 0, Leaves = 0, Crashes = 0;
+  inline static void writeMessage(int, const std::vector<uint64_t> &);
+  inline static std::vector<std::vector<uint64_t>> readMessages(int);
+  inline static void replay(Chooser &, const std::vector<uint64_t> &);
+  inline static bool waitFor(pid_t);
+
+public:
+  inline ForkRunner(Guide &_PrefixG,
+                    std::function<std::unique_ptr<Guide>()> _MakeSuffixGuide,
+                    uint64_t _ForkDepth, uint64_t _MaxSuffixes = (uint64_t)-1)
+      : PrefixG(_PrefixG), MakeSuffixGuide(_MakeSuffixGuide),
+        ForkDepth(_ForkDepth), MaxSuffixes(_MaxSuffixes) {}
+  inline ~ForkRunner() {}
+  // run the generator below one new prefix; returns false once the
+  // prefix guide has nothing left to offer
+  inline bool run(const std::function<void(Chooser &)> &Gen);
+  inline uint64_t prefixes() { return Prefixes; }
+  inline uint64_t leaves() { return Leaves; }
+  inline uint64_t crashes() { return Crashes; }
+};
+
+class ForkChooser : public Chooser {
+  friend ForkRunner;
+  ForkRunner &R;
+  // declared first so that a suffix chooser goes before its guide
+  std::unique_ptr<Guide> SuffixG;
+  std::unique_ptr<Chooser> C;
+  std::vector<uint64_t> Log;
+  uint64_t Depth = 0;
+  bool Suffix = false;
+  int Out;
+  inline void maybeFork();
+  [[noreturn]] inline void finish();
+
+public:
+  inline ForkChooser(ForkRunner &_R, std::unique_ptr<Chooser> _C, int _Out)
+      : R(_R), C(std::move(_C)), Out(_Out) {}
+  inline ~ForkChooser() {}
+  inline uint64_t choose(uint64_t Choices) override;
+  inline bool flip() override { return choose(2); }
+  inline uint64_t chooseWeighted(const std::vector<double> &) override;
+  inline uint64_t chooseWeighted(const std::vector<uint64_t> &) override;
+  inline uint64_t chooseUnimportant() override;
+  inline void beginScope() override;
+  inline void endScope() override;
+};
+
+static inline void flushOutput() {
+  std::cout.flush();
+  std::cerr.flush();
+  fflush(nullptr);
+}
+
+static inline pid_t forkWithPipe(int Fds[2]) {
+  if (pipe(Fds) != 0) {
+    std::cout << "FATAL ERROR: pipe() failed\n\n";
+    exit(-1);
+  }
+  // otherwise buffered output gets printed once per process
+  flushOutput();
+  auto Pid = fork();
+  if (Pid == -1) {
+    std::cout << "FATAL ERROR: fork() failed\n\n";
+    exit(-1);
+  }
+  return Pid;
+}
+
+void ForkRunner::writeMessage(int Fd, const std::vector<uint64_t> &Words) {
+  std::vector<uint64_t> Buf;
+  Buf.reserve(Words.size() + 1);
+  Buf.push_back(Words.size());
+  Buf.insert(Buf.end(), Words.begin(), Words.end());
+  auto P = reinterpret_cast<const char *>(Buf.data());
+  size_t Left = Buf.size() * sizeof(uint64_t);
+  while (Left > 0) {
+    auto N = write(Fd, P, Left);
+    if (N <= 0)
+      _exit(1);
+    P += N;
+    Left -= N;
+  }
+}
+
+/*
+ * read until EOF; a message that was cut short by a crash is dropped
+ */
+std::vector<std::vector<uint64_t>> ForkRunner::readMessages(int Fd) {
+  std::vector<char> Bytes;
+  char Buf[1 << 16];
+  ssize_t N;
+  while ((N = read(Fd, Buf, sizeof(Buf))) > 0)
+    Bytes.insert(Bytes.end(), Buf, Buf + N);
+  std::vector<uint64_t> Words(Bytes.size() / sizeof(uint64_t));
+  if (!Words.empty())
+    memcpy(Words.data(), Bytes.data(), Words.size() * sizeof(uint64_t));
+  std::vector<std::vector<uint64_t>> Messages;
+  size_t Pos = 0;
+  while (Pos < Words.size() && Pos + 1 + Words.at(Pos) <= Words.size()) {
+    Messages.emplace_back(Words.begin() + Pos + 1,
+                          Words.begin() + Pos + 1 + Words.at(Pos));
+    Pos += 1 + Words.at(Pos);
+  }
+  return Messages;
+}
+
+void ForkRunner::replay(Chooser &C, const std::vector<uint64_t> &Log) {
+  size_t Pos = 0;
+  auto Next = [&]() { return Log.at(Pos++); };
+  while (Pos < Log.size()) {
+    uint64_t X;
+    switch ((CallKind)Next()) {
+    case CallKind::CHOOSE:
+      X = C.choose(Next());
+      break;
+    case CallKind::WEIGHTED_DOUBLE: {
+      std::vector<double> Probs(Next());
+      for (auto &P : Probs) {
+        auto W = Next();
+        memcpy(&P, &W, sizeof(P));
+      }
+      X = C.chooseWeighted(Probs);
+      break;
+    }
+    case CallKind::WEIGHTED_UINT: {
+      std::vector<uint64_t> Probs(Next());
+      for (auto &P : Probs)
+        P = Next();
+      X = C.chooseWeighted(Probs);
+      break;
+    }
+    case CallKind::UNIMPORTANT:
+      X = C.chooseUnimportant();
+      break;
+    case CallKind::BEGIN_SCOPE:
+      C.beginScope();
+      continue;
+    case CallKind::END_SCOPE:
+      C.endScope();
+      continue;
+    default:
+      assert(false);
+    }
+    if (X != Next()) {
+      std::cout << "FATAL ERROR: Replayed choice differs from the one made in "
+                   "the child process; the generator or guide is "
+                   "nondeterministic\n\n";
+      exit(-1);
+    }
+  }
+}
+
+bool ForkRunner::waitFor(pid_t Pid) {
+  int Status;
+  if (waitpid(Pid, &Status, 0) != Pid)
+    return false;
+  return WIFEXITED(Status) && WEXITSTATUS(Status) == 0;
+}
+
+bool ForkRunner::run(const std::function<void(Chooser &)> &Gen) {
+  auto C = PrefixG.makeChooser();
+  if (!C)
+    return false;
+  int Fds[2];
+  auto Pid = forkWithPipe(Fds);
+  if (Pid == 0) {
+    close(Fds[0]);
+    ForkChooser FC(*this, std::move(C), Fds[1]);
+    // an exception must not unwind into our caller's code, which would
+    // then carry on in the child as a second copy of the parent
+    try {
+      Gen(FC);
+    } catch (...) {
+      _exit(1);
+    }
+    FC.finish();
+  }
+  close(Fds[1]);
+  auto Messages = readMessages(Fds[0]);
+  close(Fds[0]);
+  bool OK = waitFor(Pid);
+  /*
+   * the first message is the prefix, the second one is the number of
+   * leaves and crashes below it
+   */
+  if (Messages.empty()) {
+    std::cout << "FATAL ERROR: Generator crashed before reaching the fork "
+                 "depth\n\n";
+    exit(-1);
+  }
+  replay(*C, Messages.at(0));
+  ++Prefixes;
+  if (OK && Messages.size() == 2) {
+    Leaves += Messages.at(1).at(0);
+    Crashes += Messages.at(1).at(1);
+  } else {
+    ++Crashes;
+  }
+  if (Verbose)
+    std::cout << "prefix " << Prefixes << " done, " << Leaves
+              << " leaves so far\n";
+  return true;
+}
+
+/*
+ * called before each branching choice; at the fork depth the prefix
+ * process turns into a server that forks one child per suffix, and
+ * only the children return from here
+ */
+void ForkChooser::maybeFork() {
+  if (Suffix || Depth != R.ForkDepth)
+    return;
+  // the server's exceptions mustn't reach the generator, which could
+  // catch them and carry on as if it were a suffix
+  try {
+    ForkRunner::writeMessage(Out, Log);
+    Log.clear();
+    // our copy of the prefix guide is of no further use
+    C.reset();
+    SuffixG = R.MakeSuffixGuide();
+    uint64_t Leaves = 0, Crashes = 0;
+    while (Leaves < R.MaxSuffixes) {
+      auto SC = SuffixG->makeChooser();
+      if (!SC)
+        break;
+      int Fds[2];
+      auto Pid = forkWithPipe(Fds);
+      if (Pid == 0) {
+        close(Fds[0]);
+        close(Out);
+        Out = Fds[1];
+        C = std::move(SC);
+        Suffix = true;
+        return;
+      }
+      close(Fds[1]);
+      auto Messages = ForkRunner::readMessages(Fds[0]);
+      close(Fds[0]);
+      if (!ForkRunner::waitFor(Pid) || Messages.size() != 1) {
+        // the suffix guide is in the middle of a traversal that we
+        // can't finish, so give up on this prefix
+        ++Crashes;
+        SC.release();
+        break;
+      }
+      ForkRunner::replay(*SC, Messages.at(0));
+      ++Leaves;
+    }
+    ForkRunner::writeMessage(Out, {Leaves, Crashes});
+    flushOutput();
+  } catch (...) {
+    _exit(1);
+  }
+  _exit(0);
+}
+
+/*
+ * called when the generator returns, in whichever process that is
+ */
+void ForkChooser::finish() {
+  ForkRunner::writeMessage(Out, Log);
+  // a generator that finishes above the fork depth is its own leaf
+  if (!Suffix)
+    ForkRunner::writeMessage(Out, {1, 0});
+  flushOutput();
+  _exit(0);
+}
+
+uint64_t ForkChooser::choose(uint64_t Choices) {
+  maybeFork();
+  auto X = C->choose(Choices);
+  hashChoice(Choices, X);
+  Log.insert(Log.end(), {(uint64_t)CallKind::CHOOSE, Choices, X});
+  ++Depth;
+  return X;
+}
+
+uint64_t ForkChooser::chooseWeighted(const std::vector<double> &Probs) {
+  maybeFork();
+  auto X = C->chooseWeighted(Probs);
+  hashChoice(Probs.size(), X);
+  Log.push_back((uint64_t)CallKind::WEIGHTED_DOUBLE);
+  Log.push_back(Probs.size());
+  for (auto P : Probs) {
+    uint64_t W;
+    memcpy(&W, &P, sizeof(W));
+    Log.push_back(W);
+  }
+  Log.push_back(X);
+  ++Depth;
+  return X;
+}
+
+uint64_t ForkChooser::chooseWeighted(const std::vector<uint64_t> &Probs) {
+  maybeFork();
+  auto X = C->chooseWeighted(Probs);
+  hashChoice(Probs.size(), X);
+  Log.push_back((uint64_t)CallKind::WEIGHTED_UINT);
+  Log.push_back(Probs.size());
+  Log.insert(Log.end(), Probs.begin(), Probs.end());
+  Log.push_back(X);
+  ++Depth;
+  return X;
+}
+
+uint64_t ForkChooser::chooseUnimportant() {
+  auto X = C->chooseUnimportant();
+  Log.insert(Log.end(), {(uint64_t)CallKind::UNIMPORTANT, X});
+  return X;
+}
+
+void ForkChooser::beginScope() {
+  C->beginScope();
+  Log.push_back((uint64_t)CallKind::BEGIN_SCOPE);
+}
+
+void ForkChooser::endScope() {
+  C->endScope();
+  Log.push_back((uint64_t)CallKind::END_SCOPE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace tree_guide
+
+#endif // __linux__
+
+#endif
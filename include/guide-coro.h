@@ -0,0 +1,321 @@
+#ifndef TREE_GUIDE_CORO_H_
+#define TREE_GUIDE_CORO_H_
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "guide.h"
+
+namespace tree_guide {
+namespace coro {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * an optional C++20 coroutine interface for generators. a generator
+ * is written as a coroutine returning Traversal<T> and each decision
+ * is a co_await:
+ *
+ *   Traversal<std::string> gen(int Depth) {
+ *     if (Depth == 0 || co_await flip())
+ *       co_return "x";
+ *     co_return "(" + co_await gen(Depth - 1) + ")";
+ *   }
+ *
+ * a traversal suspends at every choice point and stays suspended
+ * until whoever is driving it supplies the answer, so a driver can
+ * keep many traversals in flight on a single thread, interleaving
+ * their choices (see Interleaver). run() is the bridge to the
+ * synchronous Chooser API, which remains the normal way to write a
+ * generator.
+ *
+ * every answer still comes from an ordinary Chooser, one choice at a
+ * time; there is no batched guide call. and a suspended traversal
+ * can't be cloned: coroutine frames are not copyable, so running
+ * several suffixes from one prefix still requires re-execution (or
+ * ForkRunner).
+ */
+
+enum class RequestKind {
+  CHOOSE,
+  WEIGHTED_DOUBLE,
+  WEIGHTED_UINT,
+  UNIMPORTANT,
+  BEGIN_SCOPE,
+  END_SCOPE
+};
+
+/*
+ * a pending choice; the weights belong to the suspended coroutine and
+ * remain valid until it is resumed
+ */
+struct Request {
+  RequestKind Kind;
+  uint64_t N = 0;
+  const std::vector<double> *DoubleProbs = nullptr;
+  const std::vector<uint64_t> *UintProbs = nullptr;
+};
+
+// answer a request using an ordinary chooser
+inline uint64_t answer(Chooser &C, const Request &R) {
+  switch (R.Kind) {
+  case RequestKind::CHOOSE:
+    return C.choose(R.N);
+  case RequestKind::WEIGHTED_DOUBLE:
+    return C.chooseWeighted(*R.DoubleProbs);
+  case RequestKind::WEIGHTED_UINT:
+    return C.chooseWeighted(*R.UintProbs);
+  case RequestKind::UNIMPORTANT:
+    return C.chooseUnimportant();
+  case RequestKind::BEGIN_SCOPE:
+    C.beginScope();
+    return 0;
+  case RequestKind::END_SCOPE:
+    C.endScope();
+    return 0;
+  }
+  assert(false);
+  return 0;
+}
+
+/*
+ * shared by a top-level traversal and all of the traversals that it
+ * awaits: the innermost one that is waiting for a choice, and the
+ * choice itself
+ */
+struct RootState {
+  std::coroutine_handle<> Current;
+  Request Pending;
+  uint64_t Answer = 0;
+  bool Waiting = false;
+};
+
+struct PromiseBase {
+  RootState *Root = nullptr;
+  std::coroutine_handle<> Continuation;
+  std::exception_ptr Exception;
+};
+
+class ChoiceAwaiter {
+  Request R;
+  RootState *Root = nullptr;
+
+public:
+  inline ChoiceAwaiter(Request _R) : R(_R) {}
+  inline bool await_ready() { return false; }
+  template <typename P> void await_suspend(std::coroutine_handle<P> H) {
+    Root = H.promise().Root;
+    assert(Root);
+    Root->Pending = R;
+    Root->Current = H;
+    Root->Waiting = true;
+  }
+  inline uint64_t await_resume() { return Root->Answer; }
+};
+
+inline ChoiceAwaiter choose(uint64_t N) {
+  return ChoiceAwaiter({RequestKind::CHOOSE, N});
+}
+
+inline ChoiceAwaiter flip() { return choose(2); }
+
+inline ChoiceAwaiter chooseWeighted(const std::vector<double> &Probs) {
+  return ChoiceAwaiter({RequestKind::WEIGHTED_DOUBLE, 0, &Probs});
+}
+
+inline ChoiceAwaiter chooseWeighted(const std::vector<uint64_t> &Probs) {
+  return ChoiceAwaiter({RequestKind::WEIGHTED_UINT, 0, nullptr, &Probs});
+}
+
+inline ChoiceAwaiter chooseUnimportant() {
+  return ChoiceAwaiter({RequestKind::UNIMPORTANT});
+}
+
+inline ChoiceAwaiter beginScope() {
+  return ChoiceAwaiter({RequestKind::BEGIN_SCOPE});
+}
+
+inline ChoiceAwaiter endScope() {
+  return ChoiceAwaiter({RequestKind::END_SCOPE});
+}
+
+template <typename T> class Traversal {
+public:
+  struct promise_type : PromiseBase {
+    std::optional<T> Value;
+    Traversal get_return_object() {
+      return Traversal(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    // when a traversal finishes, control goes back to whoever awaited
+    // it, or to the driver if nobody did
+    auto final_suspend() noexcept {
+      struct Final {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<promise_type> H) noexcept {
+          auto C = H.promise().Continuation;
+          return C ? C : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+      };
+      return Final{};
+    }
+    void return_value(T V) { Value = std::move(V); }
+    void unhandled_exception() { Exception = std::current_exception(); }
+  };
+
+private:
+  std::coroutine_handle<promise_type> H;
+  inline explicit Traversal(std::coroutine_handle<promise_type> _H) : H(_H) {}
+
+public:
+  inline Traversal(Traversal &&Other) : H(Other.H) { Other.H = nullptr; }
+  Traversal(const Traversal &) = delete;
+  Traversal &operator=(const Traversal &) = delete;
+  inline ~Traversal() {
+    if (H)
+      H.destroy();
+  }
+
+  /*
+   * awaiting a traversal from inside another one runs it like a
+   * subroutine, sharing the caller's root
+   */
+  inline bool await_ready() { return false; }
+  template <typename P>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<P> Caller) {
+    H.promise().Root = Caller.promise().Root;
+    H.promise().Continuation = Caller;
+    return H;
+  }
+  inline T await_resume() { return result(); }
+
+  /*
+   * interface for drivers
+   */
+  inline void start(RootState &Root) {
+    H.promise().Root = &Root;
+    Root.Current = H;
+  }
+  // resume until the next choice point; returns false once finished
+  inline bool step(RootState &Root) {
+    Root.Waiting = false;
+    Root.Current.resume();
+    return Root.Waiting;
+  }
+  inline T result() {
+    if (H.promise().Exception)
+      std::rethrow_exception(H.promise().Exception);
+    return std::move(*H.promise().Value);
+  }
+};
+
+/*
+ * drive a traversal to completion using an ordinary chooser
+ */
+template <typename T> T run(Traversal<T> Tr, Chooser &C) {
+  RootState Root;
+  Tr.start(Root);
+  while (Tr.step(Root))
+    Root.Answer = answer(C, Root.Pending);
+  return Tr.result();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Interleaver: keeps up to Width traversals in flight at once, each
+ * with its own chooser. every round resumes all of them to their next
+ * choice point, and then answers each pending choice from its slot's
+ * chooser. the guide has to tolerate several outstanding choosers
+ * (DefaultGuide does; BFSGuide, for example, does not)
+ */
+
+template <typename T> class Interleaver {
+  struct Slot {
+    std::unique_ptr<Chooser> C;
+    std::optional<Traversal<T>> Tr;
+    RootState Root;
+  };
+  Guide &G;
+  std::function<Traversal<T>()> Make;
+  std::vector<std::unique_ptr<Slot>> Slots;
+  uint64_t Rounds = 0;
+  bool GuideDone = false;
+  inline bool refill(Slot &, uint64_t &Remaining);
+
+public:
+  inline Interleaver(Guide &_G, std::function<Traversal<T>()> _Make,
+                     size_t Width)
+      : G(_G), Make(_Make) {
+    for (size_t i = 0; i < Width; ++i)
+      Slots.push_back(std::make_unique<Slot>());
+  }
+  // complete up to Count traversals, passing each result to Done;
+  // returns the number completed
+  inline uint64_t run(uint64_t Count, std::function<void(T &)> Done);
+  inline uint64_t rounds() { return Rounds; }
+};
+
+template <typename T>
+bool Interleaver<T>::refill(Slot &S, uint64_t &Remaining) {
+  S.Tr.reset();
+  S.C.reset();
+  if (Remaining == 0 || GuideDone)
+    return false;
+  S.C = G.makeChooser();
+  if (!S.C) {
+    GuideDone = true;
+    return false;
+  }
+  --Remaining;
+  S.Tr.emplace(Make());
+  S.Tr->start(S.Root);
+  return true;
+}
+
+template <typename T>
+uint64_t Interleaver<T>::run(uint64_t Count, std::function<void(T &)> Done) {
+  uint64_t Remaining = Count, Completed = 0;
+  std::vector<Slot *> Active;
+  for (auto &S : Slots)
+    if (refill(*S, Remaining))
+      Active.push_back(S.get());
+  while (!Active.empty()) {
+    ++Rounds;
+    std::vector<Slot *> Waiting;
+    for (auto S : Active) {
+      // a slot that finishes immediately starts over with a new
+      // traversal, which then also needs to reach its first choice
+      while (!S->Tr->step(S->Root)) {
+        auto Result = S->Tr->result();
+        Done(Result);
+        ++Completed;
+        if (!refill(*S, Remaining))
+          break;
+      }
+      if (S->Tr)
+        Waiting.push_back(S);
+    }
+    for (auto S : Waiting)
+      S->Root.Answer = answer(*S->C, S->Root.Pending);
+    Active = Waiting;
+  }
+  return Completed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace coro
+} // namespace tree_guide
+
+#endif
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef TREE_GUIDE_H_
 #define TREE_GUIDE_H_
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <fstream>
 #include <functional>
 #include <iostream>
@@ -9,7 +11,9 @@
 #include <optional>
 #include <queue>
 #include <random>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace tree_guide {
@@ -18,16 +22,71 @@ static const bool Verbose = false;
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// the splitmix64 finalizer: a cheap, well-mixed 64-bit hash that we
+// use for hashing choices and prefixes
+inline uint64_t mix64(uint64_t X) {
+  X += 0x9e3779b97f4a7c15ULL;
+  X = (X ^ (X >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  X = (X ^ (X >> 27)) * 0x94d049bb133111ebULL;
+  return X ^ (X >> 31);
+}
+
+/*
+ * a 128-bit rolling hash of the (arity, choice) pairs along a path
+ * through the decision tree, in two independently mixed lanes
+ */
+struct PathHash {
+  uint64_t Lo = 0, Hi = 0;
+  inline void add(uint64_t Choices, uint64_t Choice) {
+    Lo = mix64(Lo ^ mix64(Choice ^ mix64(Choices)));
+    Hi = mix64((Hi + Choice) * 0x2545f4914f6cdd1dULL + Choices);
+  }
+  inline bool operator==(const PathHash &O) const {
+    return Lo == O.Lo && Hi == O.Hi;
+  }
+  inline bool operator!=(const PathHash &O) const { return !(*this == O); }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * one branching decision along a recorded path: the number of
+ * choices, the weights if it was a weighted choice, and what was
+ * chosen
+ */
+struct Step {
+  uint64_t Choices, Choice;
+  std::vector<double> Weights;
+};
+
+/*
+ * makes a decision on a chooser's behalf: given the number of
+ * choices, either sets the choice and returns true, or returns false
+ * to hand the decision (and all later ones) back to the chooser
+ */
+using Steer = std::function<bool(uint64_t Choices, uint64_t &Choice)>;
+
 /*
  * abstract base classes for all of the guides and choosers
  */
 
 class Chooser {
+  PathHash Path;
+
 protected:
   Chooser() {}
+  // every chooser that makes its own decisions feeds them in here
+  inline void hashChoice(uint64_t Choices, uint64_t Choice) {
+    Path.add(Choices, Choice);
+  }
+  // for choosers that get reused across traversals
+  inline void resetPathHash() { Path = PathHash(); }
 
 public:
   virtual ~Chooser() {}
+  // hash of the branching choices made so far; choosers that wrap
+  // another chooser forward this to it
+  virtual PathHash pathHash() { return Path; }
   // return a number in 0..n
   virtual uint64_t choose(uint64_t n) = 0;
   // shorthand for choose(2)
@@ -54,6 +113,23 @@ public:
   virtual ~Guide() {}
   virtual std::unique_ptr<Chooser> makeChooser() = 0;
   virtual const std::string name() = 0;
+  /*
+   * learn from a path through the decision tree that was taken
+   * elsewhere (see TracingChooser), as if one of our own choosers had
+   * taken it, so that a new campaign can start out knowing what's
+   * already been explored. returns false if this guide can't do that
+   */
+  virtual bool ingest(const std::vector<Step> &) { return false; }
+  /*
+   * a chooser whose decisions are made by the Steer until it hands
+   * them back, and which learns from them as if they had been its
+   * own; this lets a wrapper like CorpusGuide start a traversal down
+   * a path of its choosing and have us carry on from there. returns
+   * null if this guide can't do that
+   */
+  virtual std::unique_ptr<Chooser> makeSteeredChooser(Steer) {
+    return nullptr;
+  }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -66,6 +142,7 @@ public:
  */
 
 class DefaultGuide;
+class ValueSource;
 
 class DefaultChooser : public Chooser {
   DefaultGuide &G;
@@ -85,6 +162,7 @@ public:
 class DefaultGuide : public Guide {
   friend DefaultChooser;
   std::unique_ptr<std::mt19937_64> Rand;
+  ValueSource *Values = nullptr;
 
 public:
   inline DefaultGuide(uint64_t Seed) {
@@ -96,21 +174,30 @@ public:
     return std::make_unique<DefaultChooser>(*this);
   }
   inline const std::string name() override { return "default"; }
+  // where chooseUnimportant() gets its values; by default, uniformly
+  // from the full 64-bit range
+  inline void setValueSource(ValueSource *V) { Values = V; }
 };
 
 uint64_t DefaultChooser::choose(uint64_t Choices) {
   std::uniform_int_distribution<int> Dist(0, Choices - 1);
-  return Dist(*G.Rand.get());
+  uint64_t X = Dist(*G.Rand.get());
+  hashChoice(Choices, X);
+  return X;
 }
 
 uint64_t DefaultChooser::chooseWeighted(const std::vector<double> &Probs) {
   std::discrete_distribution<uint64_t> Discrete(Probs.begin(), Probs.end());
-  return Discrete(*G.Rand.get());
+  auto X = Discrete(*G.Rand.get());
+  hashChoice(Probs.size(), X);
+  return X;
 }
 
 uint64_t DefaultChooser::chooseWeighted(const std::vector<uint64_t> &Probs) {
   std::discrete_distribution<uint64_t> Discrete(Probs.begin(), Probs.end());
-  return Discrete(*G.Rand.get());
+  auto X = Discrete(*G.Rand.get());
+  hashChoice(Probs.size(), X);
+  return X;
 }
 
 inline uint64_t fullRange(std::mt19937_64 &G) {
@@ -120,8 +207,96 @@ inline uint64_t fullRange(std::mt19937_64 &G) {
   return Dist(G);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+struct rec;
+
+/*
+ * ValueSource: where a chooser gets values that don't shape the
+ * decision tree, such as those returned by chooseUnimportant(). a
+ * guide that takes one doesn't own it
+ */
+
+class ValueSource {
+public:
+  virtual ~ValueSource() {}
+  virtual uint64_t next(std::mt19937_64 &R) = 0;
+};
+
+/*
+ * InterestingValues: uniformly random 64-bit values almost never hit
+ * the edge cases that generated programs most need, such as 0, -1,
+ * INT_MAX or a power of two. with probability P, this returns either
+ * one of a built-in table of such values or one that was harvested
+ * from test cases worth keeping, and otherwise a random value. the
+ * table has small numbers, powers of two and their neighbours, which
+ * include the limits of the signed and unsigned integer types, and
+ * the negations of all of these. at most MaxHarvested values are
+ * kept, each only once
+ */
+
+class InterestingValues : public ValueSource {
+  std::vector<uint64_t> Builtin, Harvested;
+  std::unordered_set<uint64_t> Known;
+  double P;
+  size_t MaxHarvested;
+
+public:
+  inline InterestingValues(double _P = 0.5, size_t _MaxHarvested = 4096);
+  inline uint64_t next(std::mt19937_64 &R) override;
+  inline void add(uint64_t V);
+  // add all of the values in a saved choice sequence
+  inline void harvest(const std::vector<rec> &Choices);
+  inline const std::vector<uint64_t> &builtin() const { return Builtin; }
+  inline const std::vector<uint64_t> &harvested() const { return Harvested; }
+};
+
+InterestingValues::InterestingValues(double _P, size_t _MaxHarvested)
+    : P(_P), MaxHarvested(_MaxHarvested) {
+  for (uint64_t V = 0; V <= 16; ++V)
+    Builtin.push_back(V);
+  for (int K = 0; K < 64; ++K) {
+    uint64_t Pow = 1ULL << K;
+    Builtin.push_back(Pow - 1);
+    Builtin.push_back(Pow);
+    Builtin.push_back(Pow + 1);
+  }
+  auto N = Builtin.size();
+  for (size_t I = 0; I < N; ++I)
+    Builtin.push_back(-Builtin[I]);
+  std::sort(Builtin.begin(), Builtin.end());
+  Builtin.erase(std::unique(Builtin.begin(), Builtin.end()), Builtin.end());
+  Known.insert(Builtin.begin(), Builtin.end());
+}
+
+uint64_t InterestingValues::next(std::mt19937_64 &R) {
+  std::uniform_real_distribution<double> Coin(0.0, 1.0);
+  if (Coin(R) >= P)
+    return fullRange(R);
+  // half of the time, if there are any, a harvested value
+  auto &Table = (!Harvested.empty() && Coin(R) < 0.5) ? Harvested : Builtin;
+  std::uniform_int_distribution<size_t> Dist(0, Table.size() - 1);
+  return Table.at(Dist(R));
+}
+
+void InterestingValues::add(uint64_t V) {
+  if (MaxHarvested == 0 || !Known.insert(V).second)
+    return;
+  if (Harvested.size() < MaxHarvested) {
+    Harvested.push_back(V);
+    return;
+  }
+  // when we're full, the new value replaces an old one, picked by
+  // hashing so that we don't need randomness here
+  auto &Old = Harvested.at(mix64(V) % Harvested.size());
+  Known.erase(Old);
+  Old = V;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 uint64_t DefaultChooser::chooseUnimportant() {
-  return fullRange(*G.Rand.get());
+  return G.Values ? G.Values->next(*G.Rand) : fullRange(*G.Rand.get());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -211,9 +386,11 @@ public:
 };
 
 class BFSChooser;
+class WeightedSamplerGuide;
 
 class BFSGuide : public Guide {
   friend BFSChooser;
+  friend WeightedSamplerGuide;
   struct Node {
     Node *Parent;
     std::vector<std::unique_ptr<BFSGuide::Node>> Children;
@@ -223,15 +400,22 @@ class BFSGuide : public Guide {
   std::unique_ptr<BFSGuide::Node> Root;
   PriQ<Node *> PendingPaths;
   uint64_t MaxSavedLevel = (uint64_t)-1;
-  bool Choosing = false, Started = false;
+  uint64_t Outstanding = 0;
+  bool Started = false;
   // TODO move this into the chooser?
   std::unique_ptr<std::mt19937_64> Rand;
+  inline std::vector<uint64_t>
+  pathTo(Node *, std::unordered_map<Node *, uint64_t> &Indices);
+  inline uint64_t indexOf(Node *);
 
 public:
   inline BFSGuide(uint64_t Seed);
   inline BFSGuide() : BFSGuide(std::random_device{}()) {}
   inline ~BFSGuide() {}
   inline std::unique_ptr<Chooser> makeChooser() override;
+  inline std::vector<std::unique_ptr<Chooser>> makeChoosers(uint64_t K);
+  inline bool ingest(const std::vector<Step> &) override;
+  inline std::unique_ptr<Chooser> makeSteeredChooser(Steer) override;
   inline const std::string name() override { return "BFS"; }
 };
 
@@ -242,10 +426,17 @@ class BFSChooser : public Chooser {
   uint64_t LastChoice = 0, Level = 0;
   // this vector is in reverse order so we can pop stuff efficiently
   std::vector<uint64_t> SavedChoices;
+  // set for choosers from makeSteeredChooser(), which follow the
+  // steer instead of a plan, and then choose randomly
+  Steer Steering;
+  bool Unplanned = false;
   inline uint64_t chooseInternal(uint64_t, std::function<uint64_t()>);
 
 public:
-  inline BFSChooser(BFSGuide &_G) : G(_G) { Current = &*G.Root; }
+  inline BFSChooser(BFSGuide &_G) : G(_G) {
+    Current = &*G.Root;
+    G.Outstanding++;
+  }
   inline ~BFSChooser();
   inline uint64_t choose(uint64_t Choices) override;
   inline bool flip() override;
@@ -263,86 +454,129 @@ BFSGuide::BFSGuide(uint64_t Seed) {
 }
 
 std::unique_ptr<Chooser> BFSGuide::makeChooser() {
+  auto Choosers = makeChoosers(1);
+  if (Choosers.empty())
+    return nullptr;
+  return std::move(Choosers.at(0));
+}
+
+/*
+ * the reversed path of choices from the root to N. Indices remembers
+ * where each node on the way sits among its siblings, so that paths
+ * through a common ancestor only search its siblings once
+ */
+std::vector<uint64_t>
+BFSGuide::pathTo(Node *N, std::unordered_map<Node *, uint64_t> &Indices) {
+  std::vector<uint64_t> Path;
+  for (; N->Parent != Root.get(); N = N->Parent) {
+    auto It = Indices.find(N);
+    if (It == Indices.end())
+      It = Indices.emplace(N, indexOf(N)).first;
+    Path.push_back(It->second);
+  }
+  return Path;
+}
+
+uint64_t BFSGuide::indexOf(Node *N) {
+  auto &Siblings = N->Parent->Children;
+  for (uint64_t i = 0; i < Siblings.size(); ++i)
+    if (Siblings.at(i).get() == N)
+      return i;
+  assert(false);
+  return (uint64_t)-1;
+}
+
+/*
+ * plan up to K traversals in one pass over the frontier. all of the
+ * choosers may be outstanding at once: an untaken edge handed out
+ * earlier in the batch is claimed, so that no two choosers take the
+ * same one, and targets that share an ancestor share the search for
+ * its place among its siblings. all choosers from a batch have to be
+ * destroyed before the next one is planned
+ */
+std::vector<std::unique_ptr<Chooser>> BFSGuide::makeChoosers(uint64_t K) {
   if (Verbose)
-    std::cout << "*** START *** (total nodes = " << TotalNodes << ")\n";
-  assert(!Choosing);
+    std::cout << "*** START *** (total nodes = " << TotalNodes
+              << ", batch = " << K << ")\n";
+  assert(Outstanding == 0);
+  std::vector<std::unique_ptr<Chooser>> Choosers;
+  if (K == 0)
+    return Choosers;
   /*
    * case 1: this is the first traversal; we've not yet seen any of
    * the decision tree, so do a purely random traversal to bootstrap
-   * things
+   * things. there's nothing to plan the rest of the batch from yet
    */
   if (!Started) {
     if (Verbose)
       std::cout << "  First traversal\n";
     Started = true;
-    Choosing = true;
-    return std::make_unique<BFSChooser>(*this);
+    Choosers.push_back(std::make_unique<BFSChooser>(*this));
+    return Choosers;
   }
   /*
    * case 2: the priority queue has unexplored decisions for us to
    * traverse, this is where we spent most of our time of course
    */
-  auto [OptionalNode, SavedLevel] = PendingPaths.removeHead();
-  if (OptionalNode.has_value()) {
+  std::unordered_map<Node *, uint64_t> Indices;
+  std::unordered_map<Node *, std::vector<bool>> Claimed;
+  uint64_t FirstLevel = (uint64_t)-1;
+  while (Choosers.size() < K) {
+    auto [OptionalNode, SavedLevel] = PendingPaths.removeHead();
+    if (!OptionalNode.has_value())
+      break;
+    /*
+     * a batch can span several levels, and its traversals add nodes
+     * just below their targets, so across batches the frontier only
+     * stays at or below the shallowest level of the previous batch
+     */
     assert((MaxSavedLevel == (uint64_t)-1) || (SavedLevel >= MaxSavedLevel));
     if (Verbose && SavedLevel > MaxSavedLevel)
       std::cout << "fully explored up to " << SavedLevel << "\n";
-    MaxSavedLevel = SavedLevel;
-    auto C = std::make_unique<BFSChooser>(*this);
 
     auto N = OptionalNode.value();
-    BFSGuide::Node *N2 = nullptr;
-    // this loop walks up to the root, saving the decisions that we
-    // have to make to get back down here
-    do {
-      uint64_t Next = (uint64_t)-1;
-      uint64_t S = N->Children.size();
-      if (N2) {
-        // we're above the target node, so just get to the target
-        for (uint64_t i = 0; i < S; ++i) {
-          if (N->Children.at(i).get() == N2) {
-            Next = i;
-            break;
-          }
-        }
-        if (Verbose)
-          std::cout << "  appending " << Next
-                    << " to saved choice above target node\n";
-      } else {
-        // we're at the target node, so find an untaken branch
-        // TODO: this is deterministic, it would be better to pick a random one
-        uint64_t NumUntaken = 0;
-        for (uint64_t i = 0; i < S; ++i) {
-          if (Verbose)
-            std::cout << "    child " << i << " = " << N->Children.at(i).get()
-                      << "\n";
-          if (N->Children.at(i).get() == nullptr) {
-            NumUntaken++;
-            Next = i;
-          }
-        }
-        if (Verbose)
-          std::cout << "  appending " << Next
-                    << " to saved choice at target node\n";
-        // this node should not have been there if there wasn't a branch
-        // left to explore
-        assert(NumUntaken > 0);
-        // if there's at least one remaining unexplored branch, put
-        // this node back at the end of its priority queue
-        if (NumUntaken > 1) {
-          if (Verbose)
-            std::cout << "  Re-inserting node\n";
-          PendingPaths.insert(N, SavedLevel);
-        }
+    // we're at the target node, so find an untaken branch that
+    // nobody else in this batch is taking
+    // TODO: this is deterministic, it would be better to pick a random one
+    uint64_t S = N->Children.size();
+    auto &Taken = Claimed[N];
+    if (Taken.empty())
+      Taken.resize(S);
+    uint64_t NumUntaken = 0, Next = (uint64_t)-1;
+    for (uint64_t i = 0; i < S; ++i) {
+      if (Verbose)
+        std::cout << "    child " << i << " = " << N->Children.at(i).get()
+                  << "\n";
+      if (N->Children.at(i).get() == nullptr && !Taken.at(i)) {
+        NumUntaken++;
+        Next = i;
       }
-      assert(Next != (uint64_t)-1);
-      C->SavedChoices.push_back(Next);
-      N2 = N;
-      N = N->Parent;
-    } while (N != Root.get());
-    Choosing = true;
-    return C;
+    }
+    // ingested paths can fill in the rest of a node's branches while
+    // it's waiting in the queue
+    if (NumUntaken == 0)
+      continue;
+    if (Verbose)
+      std::cout << "  appending " << Next << " to saved choice at target node\n";
+    if (FirstLevel == (uint64_t)-1)
+      FirstLevel = SavedLevel;
+    auto C = std::make_unique<BFSChooser>(*this);
+    Taken.at(Next) = true;
+    // if there's at least one remaining unexplored branch, put this
+    // node back at the end of its priority queue
+    if (NumUntaken > 1) {
+      if (Verbose)
+        std::cout << "  Re-inserting node\n";
+      PendingPaths.insert(N, SavedLevel);
+    }
+    C->SavedChoices.push_back(Next);
+    // now the decisions that we have to make to get back down here
+    auto Path = pathTo(N, Indices);
+    C->SavedChoices.insert(C->SavedChoices.end(), Path.begin(), Path.end());
+    Choosers.push_back(std::move(C));
   }
+  if (FirstLevel != (uint64_t)-1)
+    MaxSavedLevel = FirstLevel;
   /*
    * case 3: the priority queue has run out of things for us to
    * explore; we're done. this is not going to happen in practice for
@@ -353,9 +587,77 @@ std::unique_ptr<Chooser> BFSGuide::makeChooser() {
    * don't cause branching in the tree, generators could use this to
    * generate things like wide literal constants
    */
-  if (Verbose)
+  if (Verbose && Choosers.empty())
     std::cout << "  Tree has been completely explored!\n";
-  return nullptr;
+  return Choosers;
+}
+
+/*
+ * add a recorded path to the tree. its decision nodes go into the
+ * queue like any others, and since they can be shallower than where
+ * the search has got to, the search starts over from the shallowest
+ * unexplored branch
+ */
+bool BFSGuide::ingest(const std::vector<Step> &Path) {
+  if (Outstanding != 0) {
+    std::cout << "FATAL ERROR: Can't ingest a path while choosers are "
+                 "outstanding\n\n";
+    exit(-1);
+  }
+  Started = true;
+  MaxSavedLevel = (uint64_t)-1;
+  Node *Current = Root.get();
+  uint64_t LastChoice = 0, Level = 0;
+  for (auto &S : Path) {
+    if (S.Choice >= S.Choices) {
+      std::cout << "FATAL ERROR: Recorded choice out of range\n\n";
+      exit(-1);
+    }
+    auto N = Current->Children.at(LastChoice).get();
+    if (N) {
+      if (S.Choices != N->Children.size()) {
+        std::cout << "FATAL ERROR: Reached same node again, but different "
+                     "number of choices this time\n\n";
+        exit(-1);
+      }
+    } else {
+      N = new BFSGuide::Node;
+      TotalNodes++;
+      N->Parent = Current;
+      N->Children.resize(S.Choices);
+      Current->Children.at(LastChoice) = std::unique_ptr<BFSGuide::Node>(N);
+      if (S.Choices > 1)
+        PendingPaths.insert(N, Level);
+    }
+    Current = N;
+    LastChoice = S.Choice;
+    Level++;
+  }
+  if (!Current->Children.at(LastChoice).get()) {
+    Current->Children.at(LastChoice) = std::make_unique<BFSGuide::Node>();
+    Current->Children.at(LastChoice)->Parent = Current;
+    TotalNodes++;
+  }
+  return true;
+}
+
+/*
+ * a steered traversal adds its decision nodes to the tree and the
+ * queue as an ingested path does, and once the steer is done it
+ * carries on randomly, like the first traversal
+ */
+std::unique_ptr<Chooser> BFSGuide::makeSteeredChooser(Steer S) {
+  if (Outstanding != 0) {
+    std::cout << "FATAL ERROR: Can't steer a chooser while choosers are "
+                 "outstanding\n\n";
+    exit(-1);
+  }
+  Started = true;
+  MaxSavedLevel = (uint64_t)-1;
+  auto C = std::make_unique<BFSChooser>(*this);
+  C->Steering = std::move(S);
+  C->Unplanned = true;
+  return C;
 }
 
 BFSChooser::~BFSChooser() {
@@ -366,12 +668,12 @@ BFSChooser::~BFSChooser() {
     Current->Children.at(LastChoice) = std::make_unique<BFSGuide::Node>();
     G.TotalNodes++;
   }
-  G.Choosing = false;
+  G.Outstanding--;
 }
 
 uint64_t BFSChooser::chooseInternal(const uint64_t Choices,
                                     std::function<uint64_t()> randomChoice) {
-  assert(G.Choosing);
+  assert(G.Outstanding > 0);
   if (Verbose) {
     std::cout << "choose(" << Choices << ")\n";
     std::cout << "  Current = " << Current << ", LastChoice = " << LastChoice
@@ -379,6 +681,9 @@ uint64_t BFSChooser::chooseInternal(const uint64_t Choices,
   }
 
   uint64_t Choice;
+  bool Steered = Steering && Steering(Choices, Choice);
+  if (!Steered)
+    Steering = nullptr;
   auto N = Current->Children.at(LastChoice).get();
   if (Verbose)
     std::cout << "Node pointer = " << N << "\n";
@@ -394,18 +699,24 @@ uint64_t BFSChooser::chooseInternal(const uint64_t Choices,
                    "number of choices this time\n\n";
       exit(-1);
     }
-    uint64_t NumSavedChoices = SavedChoices.size();
-    if (Verbose)
-      std::cout << "  There are " << NumSavedChoices << " saved choices\n";
-    assert(NumSavedChoices > 0);
-    Choice = SavedChoices.at(NumSavedChoices - 1);
-    if (Verbose)
-      std::cout << "  We'll be taking option " << Choice << "\n";
-    SavedChoices.pop_back();
+    if (Unplanned) {
+      // there's no plan to follow, so past the steer we pick randomly
+      if (!Steered)
+        Choice = randomChoice();
+    } else {
+      uint64_t NumSavedChoices = SavedChoices.size();
+      if (Verbose)
+        std::cout << "  There are " << NumSavedChoices << " saved choices\n";
+      assert(NumSavedChoices > 0);
+      Choice = SavedChoices.at(NumSavedChoices - 1);
+      if (Verbose)
+        std::cout << "  We'll be taking option " << Choice << "\n";
+      SavedChoices.pop_back();
+    }
   } else {
     /*
      * we're off the beaten path, add this decision node to the tree
-     * and make a random choice
+     * and make a random choice, unless we're being steered
      */
     assert(SavedChoices.size() == 0);
     N = new BFSGuide::Node;
@@ -414,7 +725,8 @@ uint64_t BFSChooser::chooseInternal(const uint64_t Choices,
     N->Children.resize(Choices);
     auto UN = std::unique_ptr<BFSGuide::Node>(N);
     Current->Children.at(LastChoice) = std::move(UN);
-    Choice = randomChoice();
+    if (!Steered)
+      Choice = randomChoice();
     /*
      * if there are other options we'll need to get back to them later
      */
@@ -428,6 +740,7 @@ uint64_t BFSChooser::chooseInternal(const uint64_t Choices,
   Current = N;
   LastChoice = Choice;
   Level++;
+  hashChoice(Choices, Choice);
   if (Verbose)
     std::cout << "  returning " << Choice << "\n";
   return Choice;
@@ -461,237 +774,1533 @@ uint64_t BFSChooser::chooseUnimportant() { return fullRange(*G.Rand.get()); }
 ////////////////////////////////////////////////////////////////////////////////
 
 /*
- * WeightedSamplerChooser: tries to explore subtrees of the decision
- * tree in an intelligent fashion using techniques resembling
- * cardinality estimation
+ * BestFirstGuide: exhaustive exploration of the decision tree like
+ * BFSGuide, but instead of going level by level, the frontier is
+ * ordered by the probability of reaching each unexplored edge, as
+ * given by the weights that the generator passes to chooseWeighted
+ * (choose() counts as uniform). beyond the known tree, a traversal
+ * always takes the most likely edge (the lowest-numbered one, if
+ * there's a tie), so it ends at the most likely leaf that it can
+ * find below its frontier edge. so, the most likely test cases come
+ * out first. this is exact whenever the most likely edge at each
+ * decision also leads to the most likely leaves, which is the usual
+ * situation for generators whose weights favor stopping; in general
+ * a traversal can't know what's below an edge that nobody has taken
  */
 
-class WeightedSamplerChooser;
-
-class WeightedSamplerGuide : public Guide {
-  friend WeightedSamplerChooser;
+class BestFirstChooser;
+class WeightedSamplerGuide;
 
+class BestFirstGuide : public Guide {
+  friend BestFirstChooser;
   struct Node {
-    bool visited = false;
-    size_t BranchFactor;
+    Node *Parent = nullptr;
+    // probability of the path from the root down to this node
+    double Prob = 1.0;
+    // normalized weights for the children, empty if they're uniform
     std::vector<double> Weights;
-    std::unordered_map<uint64_t, std::unique_ptr<Node>> Children;
-    double SizeEstimate;
-
-    inline Node() {}
-
-    inline void visit(size_t n, const std::vector<double> &weights) {
-      assert(weights.size() == 0 || weights.size() == n);
-      if (this->visited) {
-        assert(n == this->BranchFactor);
-        return;
-      } else if (n == 0) {
-        this->BranchFactor = n;
-        this->visited = true;
-        this->SizeEstimate = 1.0;
-      } else {
-        this->BranchFactor = n;
-        this->visited = true;
-        this->SizeEstimate = n;
-        if (weights.size() > 0) {
-          double total = 0.0;
-          for (const auto x : weights)
-            total += x;
-          for (const auto x : weights)
-            this->Weights.push_back(x / total * n);
-        }
-      }
-    }
-
-    inline double weight(size_t i) {
-      assert(this->visited);
-      if (this->Weights.size() > 0) {
-        return this->Weights[i];
-      } else {
-        return 1.0;
-      }
-    }
-
-    inline void visit(size_t n) {
-      std::vector<double> empty;
-      this->visit(n, empty);
+    std::vector<std::unique_ptr<BestFirstGuide::Node>> Children;
+    double weight(uint64_t i) {
+      return Weights.empty() ? 1.0 / Children.size() : Weights.at(i);
     }
-
-    inline void debug(size_t indent) {
-      assert(this->visited);
-      if (this->Children.size() == 0) {
-        std::cout << "Leaf node" << std::endl;
-        return;
-      }
-
-      std::string indent_string(indent, ' ');
-      std::cout << "Node (size estimate " << this->SizeEstimate << ");"
-                << std::endl;
+  };
+  // a frontier entry is a node along with the probability of its most
+  // likely untaken edge; ties go to the entry that was pushed first
+  struct Entry {
+    double Prob;
+    uint64_t Seq;
+    Node *N;
+    bool operator<(const Entry &E) const {
+      if (Prob != E.Prob)
+        return Prob < E.Prob;
+      return Seq > E.Seq;
     }
   };
 
-  std::unique_ptr<Node> Root;
+  uint64_t TotalNodes = 0, NextSeq = 0;
+  std::unique_ptr<BestFirstGuide::Node> Root;
+  std::priority_queue<Entry> Frontier;
+  // the node whose edge the current chooser is exploring; it goes
+  // back into the frontier once that edge has been taken
+  Node *Revisit = nullptr;
+  bool Choosing = false, Started = false;
   std::unique_ptr<std::mt19937_64> Rand;
+  inline uint64_t bestUntaken(Node *N, uint64_t Exclude);
+  inline void push(Node *N, uint64_t Exclude = (uint64_t)-1);
 
 public:
-  inline WeightedSamplerGuide(uint64_t Seed) {
-    this->Root = std::make_unique<Node>();
-    this->Rand = std::make_unique<std::mt19937_64>(Seed);
-  }
-  inline WeightedSamplerGuide() : WeightedSamplerGuide(0) {}
-  inline ~WeightedSamplerGuide() {}
+  inline BestFirstGuide(uint64_t Seed);
+  inline BestFirstGuide() : BestFirstGuide(std::random_device{}()) {}
+  inline ~BestFirstGuide() {}
   inline std::unique_ptr<Chooser> makeChooser() override;
-  inline void debugTree() { this->Root->debug(0); }
-  inline const std::string name() override { return "weighted sample"; }
+  // start out from what another guide has learned; see "transferring
+  // state between guides" below
+  inline void transferFrom(WeightedSamplerGuide &);
+  inline const std::string name() override { return "best-first"; }
 };
 
-class WeightedSamplerChooser : public Chooser {
-  WeightedSamplerGuide &G;
-  std::vector<WeightedSamplerGuide::Node *> Trail;
+class BestFirstChooser : public Chooser {
+  friend BestFirstGuide;
+  BestFirstGuide &G;
+  BestFirstGuide::Node *Current;
+  uint64_t LastChoice = 0;
+  // this vector is in reverse order so we can pop stuff efficiently
+  std::vector<uint64_t> SavedChoices;
+  inline uint64_t chooseInternal(uint64_t, const std::vector<double> &);
 
 public:
-  inline WeightedSamplerChooser(WeightedSamplerGuide &_G) : G(_G) {
-    this->Trail.push_back(this->G.Root.get());
-  }
-  inline ~WeightedSamplerChooser() override {
-    this->Trail.back()->visit(0);
-    this->Trail.pop_back();
-    while (this->Trail.size() > 0) {
-      WeightedSamplerGuide::Node *last = this->Trail.back();
-      double occupied = 0.0;
-      double total = 0.0;
-      for (auto &t : last->Children) {
-        auto i = t.first;
-        auto &child = t.second;
-        if (child == nullptr)
-          continue;
-        auto weight = last->weight(i);
-        total += child->SizeEstimate * weight;
-        occupied += weight;
-      }
+  inline BestFirstChooser(BestFirstGuide &_G) : G(_G) { Current = &*G.Root; }
+  inline ~BestFirstChooser();
+  inline uint64_t choose(uint64_t Choices) override;
+  inline bool flip() override { return choose(2); }
+  inline uint64_t chooseWeighted(const std::vector<double> &) override;
+  inline uint64_t chooseWeighted(const std::vector<uint64_t> &) override;
+  inline uint64_t chooseUnimportant() override;
+  inline void beginScope() override {}
+  inline void endScope() override {}
+};
 
-      last->SizeEstimate = last->Children.size() * total / occupied;
+BestFirstGuide::BestFirstGuide(uint64_t Seed) {
+  Root = std::make_unique<BestFirstGuide::Node>();
+  Root->Children.resize(1);
+  Rand = std::make_unique<std::mt19937_64>(Seed);
+}
 
-      this->Trail.pop_back();
-    }
-  };
+/*
+ * return the most likely edge of N, other than Exclude, that hasn't
+ * been taken yet, or -1 if there isn't one
+ */
+uint64_t BestFirstGuide::bestUntaken(Node *N, uint64_t Exclude) {
+  uint64_t Best = (uint64_t)-1;
+  for (uint64_t i = 0; i < N->Children.size(); ++i) {
+    if (N->Children.at(i) || i == Exclude)
+      continue;
+    if (Best == (uint64_t)-1 || N->weight(i) > N->weight(Best))
+      Best = i;
+  }
+  return Best;
+}
 
-  inline uint64_t choose(uint64_t Choices, const std::vector<double> &Weights) {
-    WeightedSamplerGuide::Node *current = this->Trail.back();
-    current->visit(Choices, Weights);
+void BestFirstGuide::push(Node *N, uint64_t Exclude) {
+  auto Best = bestUntaken(N, Exclude);
+  if (Best == (uint64_t)-1)
+    return;
+  Frontier.push({N->Prob * N->weight(Best), NextSeq++, N});
+}
 
-    size_t result;
-    WeightedSamplerGuide::Node *next_node;
-    std::uniform_real_distribution<double> unif(0.0, 1.0);
+std::unique_ptr<Chooser> BestFirstGuide::makeChooser() {
+  assert(!Choosing);
+  // the first traversal just follows the most likely edges
+  if (!Started) {
+    Started = true;
+    Choosing = true;
+    return std::make_unique<BestFirstChooser>(*this);
+  }
+  if (Frontier.empty()) {
+    if (Verbose)
+      std::cout << "  Tree has been completely explored!\n";
+    return nullptr;
+  }
+  auto E = Frontier.top();
+  Frontier.pop();
+  if (Verbose)
+    std::cout << "best-first: exploring edge with probability " << E.Prob
+              << "\n";
+  auto C = std::make_unique<BestFirstChooser>(*this);
+  auto N = E.N;
+  auto Next = bestUntaken(N, (uint64_t)-1);
+  assert(Next != (uint64_t)-1);
+  C->SavedChoices.push_back(Next);
+  Revisit = N;
+  // walk up to the root, saving the decisions that we have to make
+  // to get back down here
+  while (N->Parent != Root.get()) {
+    auto P = N->Parent;
+    uint64_t i = 0;
+    while (P->Children.at(i).get() != N)
+      ++i;
+    C->SavedChoices.push_back(i);
+    N = P;
+  }
+  Choosing = true;
+  return C;
+}
 
-    // When we visit a node we have to choose between whether to visit
-    // a child we've already seen or not (unless we've already seen every
-    // child or we've seen no children, in which case there is no choice).
-    // We consider visiting a new child to be explore, and a previous child
-    // to be exploit.
-    //
-    // The advantage of visiting previously visited children is we've got
-    // a much firmer idea of what their structure is like, so we can choose
-    // between them more sensibly. The advantage of visiting new children
+BestFirstChooser::~BestFirstChooser() {
+  assert(SavedChoices.empty());
+  if (!Current->Children.at(LastChoice).get()) {
+    auto N = std::make_unique<BestFirstGuide::Node>();
+    N->Parent = Current;
+    N->Prob = Current->Prob * Current->weight(LastChoice);
+    Current->Children.at(LastChoice) = std::move(N);
+    G.TotalNodes++;
+  }
+  if (G.Revisit) {
+    G.push(G.Revisit);
+    G.Revisit = nullptr;
+  }
+  G.Choosing = false;
+}
+
+uint64_t BestFirstChooser::chooseInternal(const uint64_t Choices,
+                                          const std::vector<double> &Weights) {
+  assert(G.Choosing);
+  uint64_t Choice;
+  auto N = Current->Children.at(LastChoice).get();
+  if (N) {
+    // we're on the way back down to an unexplored edge
+    if (Choices != N->Children.size()) {
+      std::cout << "FATAL ERROR: Reached same node again, but different "
+                   "number of choices this time\n\n";
+      exit(-1);
+    }
+    assert(SavedChoices.size() > 0);
+    Choice = SavedChoices.back();
+    SavedChoices.pop_back();
+  } else {
+    // we're off the beaten path, add this decision node to the tree
+    // and take its most likely edge
+    assert(SavedChoices.size() == 0);
+    auto UN = std::make_unique<BestFirstGuide::Node>();
+    N = UN.get();
+    G.TotalNodes++;
+    N->Parent = Current;
+    N->Prob = Current->Prob * Current->weight(LastChoice);
+    N->Children.resize(Choices);
+    Choice = 0;
+    double Total = 0.0;
+    for (auto W : Weights)
+      Total += W;
+    // weights that are all zero tell us nothing, so treat the node as
+    // uniform rather than dividing by zero
+    if (Total > 0.0) {
+      for (auto W : Weights)
+        N->Weights.push_back(W / Total);
+      Choice = G.bestUntaken(N, (uint64_t)-1);
+    }
+    Current->Children.at(LastChoice) = std::move(UN);
+    // the rest of this node's edges get explored later
+    G.push(N, Choice);
+  }
+  Current = N;
+  LastChoice = Choice;
+  hashChoice(Choices, Choice);
+  return Choice;
+}
+
+uint64_t BestFirstChooser::choose(uint64_t Choices) {
+  std::vector<double> empty;
+  return chooseInternal(Choices, empty);
+}
+
+uint64_t BestFirstChooser::chooseWeighted(const std::vector<double> &Probs) {
+  return chooseInternal(Probs.size(), Probs);
+}
+
+uint64_t BestFirstChooser::chooseWeighted(const std::vector<uint64_t> &Probs) {
+  std::vector<double> V(Probs.begin(), Probs.end());
+  return chooseInternal(Probs.size(), V);
+}
+
+uint64_t BestFirstChooser::chooseUnimportant() { return fullRange(*G.Rand); }
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * WeightedSamplerChooser: tries to explore subtrees of the decision
+ * tree in an intelligent fashion using techniques resembling
+ * cardinality estimation. subtrees that have been completely explored
+ * are marked as exhausted, and traversals stop going into them until
+ * the whole tree is exhausted, so small trees get enumerated without
+ * repeats. an exhausted subtree's size estimate stops changing, but
+ * it only counts leaves exactly where every choice is uniform: a
+ * weighted node with n children is sized as n times the weighted mean
+ * of its children's sizes, not their sum
+ */
+
+/*
+ * explore/exploit policies: at a node where some children are known
+ * and others aren't, a policy decides whether the traversal should go
+ * to a new child (explore) or to a known one (exploit). it sees these
+ * statistics about the node; the size estimates of known children are
+ * scaled by their weights
+ */
+
+struct ExploreStats {
+  // number of children, and how many of them we know about
+  uint64_t BranchFactor, Known;
+  // traversals that have gone through this node to a child, and known
+  // children that have been visited exactly once
+  uint64_t Descents, Singletons;
+  // sum, mean, and variance of the known children's size estimates
+  double KnownMass, ChildMean, ChildVariance;
+};
+
+class ExplorePolicy {
+public:
+  virtual ~ExplorePolicy() {}
+  virtual bool explore(const ExploreStats &, std::mt19937_64 &) = 0;
+  virtual const std::string name() = 0;
+};
+
+/*
+ * the original heuristic: explore rapidly at first, then once we have
+ * a decent number of children to compare, switch to a more leisurely
+ * strategy where we prefer to exploit existing children but explore
+ * occasionally
+ */
+class ThresholdPolicy : public ExplorePolicy {
+  uint64_t MinKnown;
+  double Probability;
+
+public:
+  inline ThresholdPolicy(uint64_t _MinKnown = 5, double _Probability = 0.1)
+      : MinKnown(_MinKnown), Probability(_Probability) {}
+  inline bool explore(const ExploreStats &S, std::mt19937_64 &R) override {
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    return S.Known <= MinKnown || unif(R) <= Probability;
+  }
+  inline const std::string name() override { return "threshold"; }
+};
+
+/*
+ * explore with probability equal to the share of the node's mass that
+ * we estimate lies in unknown children, where each unknown child is
+ * assumed to be as big as an upper confidence bound on the mean size
+ * of the known ones. the bound is wide when known children vary a lot
+ * in size and narrows as the node gets visited more
+ */
+class UCBPolicy : public ExplorePolicy {
+  double C;
+
+public:
+  inline UCBPolicy(double _C = 1.0) : C(_C) {}
+  inline bool explore(const ExploreStats &S, std::mt19937_64 &R) override {
+    double Unknown = S.BranchFactor - S.Known;
+    double StdErr = std::sqrt(S.ChildVariance / S.Known);
+    double Bound = S.ChildMean +
+                   C * StdErr * std::sqrt(std::log((double)S.Descents + 1.0));
+    double Unseen = Unknown * Bound;
+    if (Unseen + S.KnownMass <= 0.0)
+      return true;
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    return unif(R) < Unseen / (Unseen + S.KnownMass);
+  }
+  inline const std::string name() override { return "UCB"; }
+};
+
+/*
+ * like UCBPolicy, but instead of being optimistic, draw the size of
+ * unknown children from a normal approximation of the posterior over
+ * the mean child size
+ */
+class ThompsonPolicy : public ExplorePolicy {
+public:
+  inline bool explore(const ExploreStats &S, std::mt19937_64 &R) override {
+    double Unknown = S.BranchFactor - S.Known;
+    double StdErr = std::sqrt(S.ChildVariance / S.Known);
+    double Mean = S.ChildMean;
+    if (StdErr > 0.0) {
+      std::normal_distribution<double> Posterior(S.ChildMean, StdErr);
+      Mean = std::max(0.0, Posterior(R));
+    }
+    double Unseen = Unknown * Mean;
+    if (Unseen + S.KnownMass <= 0.0)
+      return true;
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    return unif(R) < Unseen / (Unseen + S.KnownMass);
+  }
+  inline const std::string name() override { return "Thompson"; }
+};
+
+/*
+ * the Good-Turing estimate of the probability that the next descent
+ * goes somewhere new is the fraction of descents so far that went to
+ * a child seen only once
+ */
+class GoodTuringPolicy : public ExplorePolicy {
+public:
+  inline bool explore(const ExploreStats &S, std::mt19937_64 &R) override {
+    if (S.Descents == 0)
+      return true;
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    return unif(R) < (double)S.Singletons / (double)S.Descents;
+  }
+  inline const std::string name() override { return "Good-Turing"; }
+};
+
+class WeightedSamplerChooser;
+class HybridGuide;
+
+class WeightedSamplerGuide : public Guide {
+  friend WeightedSamplerChooser;
+  friend BestFirstGuide;
+  friend HybridGuide;
+
+  struct Node {
+    bool visited = false;
+    // every child has been visited and is itself exhausted
+    bool Exhausted = false;
+    size_t BranchFactor = 0;
+    std::vector<double> Weights;
+    std::unordered_map<uint64_t, std::unique_ptr<Node>> Children;
+    // a node that has been created but not yet visited (by a planned
+    // traversal that hasn't run yet) counts as a single leaf
+    double SizeEstimate = 1.0;
+    // statistics for the explore/exploit policy; see ExploreStats
+    uint64_t Arrivals = 0, Descents = 0, Singletons = 0;
+    double KnownMass = 0.0, ChildMean = 0.0, ChildVariance = 0.0;
+
+    inline Node() {}
+
+    inline void visit(size_t n, const std::vector<double> &weights) {
+      assert(weights.size() == 0 || weights.size() == n);
+      if (this->visited) {
+        assert(n == this->BranchFactor);
+        return;
+      } else if (n == 0) {
+        this->BranchFactor = n;
+        this->visited = true;
+        this->Exhausted = true;
+        this->SizeEstimate = 1.0;
+      } else {
+        this->BranchFactor = n;
+        this->visited = true;
+        this->SizeEstimate = n;
+        if (weights.size() > 0) {
+          double total = 0.0;
+          for (const auto x : weights)
+            total += x;
+          for (const auto x : weights)
+            this->Weights.push_back(x / total * n);
+        }
+      }
+    }
+
+    inline double weight(size_t i) {
+      assert(this->visited);
+      if (this->Weights.size() > 0) {
+        return this->Weights[i];
+      } else {
+        return 1.0;
+      }
+    }
+
+    inline void visit(size_t n) {
+      std::vector<double> empty;
+      this->visit(n, empty);
+    }
+
+    // pick a child that we haven't seen yet, respecting the weights
+    inline uint64_t pickUnexplored(std::mt19937_64 &R) {
+      assert(this->Children.size() < this->BranchFactor);
+      uint64_t result;
+      if (this->Weights.size() > 0) {
+        std::discrete_distribution<uint64_t> Dist(this->Weights.begin(),
+                                                  this->Weights.end());
+        do {
+          result = Dist(R);
+        } while (this->Children.count(result));
+      } else {
+        std::uniform_int_distribution<uint64_t> Dist(0,
+                                                     this->BranchFactor - 1);
+        do {
+          result = Dist(R);
+        } while (this->Children.count(result));
+      }
+      return result;
+    }
+
+    // recompute everything that we know about this node from its
+    // children
+    inline void update() {
+      double occupied = 0.0;
+      double total = 0.0;
+      double squares = 0.0;
+      size_t exhausted = 0;
+      for (auto &t : this->Children) {
+        auto i = t.first;
+        auto &child = t.second;
+        if (child == nullptr)
+          continue;
+        auto weight = this->weight(i);
+        total += child->SizeEstimate * weight;
+        squares += child->SizeEstimate * weight * child->SizeEstimate * weight;
+        occupied += weight;
+        if (child->Exhausted)
+          ++exhausted;
+      }
+
+      this->SizeEstimate = this->Children.size() * total / occupied;
+      this->Exhausted = exhausted == this->BranchFactor;
+      this->KnownMass = total;
+      this->ChildMean = total / this->Children.size();
+      this->ChildVariance =
+          std::max(0.0, squares / this->Children.size() -
+                            this->ChildMean * this->ChildMean);
+    }
+
+    inline std::unique_ptr<Node> clone() {
+      auto N = std::make_unique<Node>();
+      N->visited = this->visited;
+      N->Exhausted = this->Exhausted;
+      N->BranchFactor = this->BranchFactor;
+      N->Weights = this->Weights;
+      for (auto &t : this->Children)
+        if (t.second != nullptr)
+          N->Children[t.first] = t.second->clone();
+      N->SizeEstimate = this->SizeEstimate;
+      N->Arrivals = this->Arrivals;
+      N->Descents = this->Descents;
+      N->Singletons = this->Singletons;
+      N->KnownMass = this->KnownMass;
+      N->ChildMean = this->ChildMean;
+      N->ChildVariance = this->ChildVariance;
+      return N;
+    }
+
+    inline void debug(size_t indent) {
+      assert(this->visited);
+      if (this->Children.size() == 0) {
+        std::cout << "Leaf node" << std::endl;
+        return;
+      }
+
+      std::string indent_string(indent, ' ');
+      std::cout << "Node (size estimate " << this->SizeEstimate << ");"
+                << std::endl;
+    }
+  };
+
+  std::unique_ptr<Node> Root;
+  std::unique_ptr<std::mt19937_64> Rand;
+  std::unique_ptr<ExplorePolicy> Policy;
+  bool StopWhenExhausted = false;
+
+public:
+  inline WeightedSamplerGuide(uint64_t Seed) {
+    this->Root = std::make_unique<Node>();
+    this->Rand = std::make_unique<std::mt19937_64>(Seed);
+    this->Policy = std::make_unique<ThresholdPolicy>();
+  }
+  inline WeightedSamplerGuide() : WeightedSamplerGuide(0) {}
+  inline ~WeightedSamplerGuide() {}
+  inline std::unique_ptr<Chooser> makeChooser() override;
+  inline std::vector<std::unique_ptr<Chooser>> makeChoosers(uint64_t K);
+  inline bool ingest(const std::vector<Step> &) override;
+  inline std::unique_ptr<Chooser> makeSteeredChooser(Steer) override;
+  inline void transferFrom(BFSGuide &);
+  inline void debugTree() { this->Root->debug(0); }
+  // estimated number of leaves in the whole tree; exact once it's
+  // exhausted, if the generator made no weighted choices
+  inline double sizeEstimate() {
+    return this->Root->visited ? this->Root->SizeEstimate : 1.0;
+  }
+  inline bool isExhausted() { return this->Root->Exhausted; }
+  // by default we keep sampling (among known leaves) once the tree
+  // has been exhausted; if this is set, makeChooser() returns null
+  // instead, like BFSGuide does
+  inline void setStopWhenExhausted(bool Stop) { StopWhenExhausted = Stop; }
+  inline void setExplorePolicy(std::unique_ptr<ExplorePolicy> P) {
+    Policy = std::move(P);
+  }
+  inline const std::string name() override { return "weighted sample"; }
+};
+
+class WeightedSamplerChooser : public Chooser {
+  friend WeightedSamplerGuide;
+  WeightedSamplerGuide &G;
+  std::vector<WeightedSamplerGuide::Node *> Trail;
+  // choices made in advance by makeChoosers(), and how many of them
+  // we've used
+  std::vector<uint64_t> Plan;
+  size_t Planned = 0;
+  // see makeSteeredChooser()
+  Steer Steering;
+
+public:
+  inline WeightedSamplerChooser(WeightedSamplerGuide &_G) : G(_G) {
+    this->Trail.push_back(this->G.Root.get());
+  }
+  inline ~WeightedSamplerChooser() override {
+    this->Trail.back()->visit(0);
+    this->Trail.pop_back();
+    while (this->Trail.size() > 0) {
+      this->Trail.back()->update();
+      this->Trail.pop_back();
+    }
+  };
+
+  inline uint64_t choose(uint64_t Choices, const std::vector<double> &Weights) {
+    WeightedSamplerGuide::Node *current = this->Trail.back();
+    current->visit(Choices, Weights);
+
+    // this part of the path was decided by makeChoosers()
+    if (this->Planned < this->Plan.size())
+      return this->descend(this->Plan.at(this->Planned++));
+
+    // and this part by the steer
+    uint64_t steered;
+    if (this->Steering && this->Steering(Choices, steered)) {
+      auto &child = current->Children[steered];
+      if (child == nullptr)
+        child = std::make_unique<WeightedSamplerGuide::Node>();
+      return this->descend(steered);
+    }
+    this->Steering = nullptr;
+
+    size_t result;
+    WeightedSamplerGuide::Node *next_node;
+
+    // When we visit a node we have to choose between whether to visit
+    // a child we've already seen or not (unless we've already seen every
+    // child or we've seen no children, in which case there is no choice).
+    // We consider visiting a new child to be explore, and a previous child
+    // to be exploit.
+    //
+    // The advantage of visiting previously visited children is we've got
+    // a much firmer idea of what their structure is like, so we can choose
+    // between them more sensibly. The advantage of visiting new children
     // is it allows us to explore previously unvisited areas of the search
     // space.
     //
-    // We don't have any particularly good way of making this decision. The
-    // current heuristic does its best to balance explore and exploit while
-    // still trying to be useful for a large branch factor. As a result we
-    // rapidly at first and then once we have a decent number of nodes to
-    // compare, we switch to a more leisurely strategy where we prefer to
-    // exploit existing nodes but explore occasionally.
-    bool explore =
-        (current->Children.size() < current->BranchFactor &&
-         (current->Children.size() <= 5 || unif(*G.Rand.get()) <= 0.1));
+    // We don't have any particularly good way of making this decision, so
+    // it's up to the guide's ExplorePolicy; the default, ThresholdPolicy,
+    // does its best to balance explore and exploit while still trying to
+    // be useful for a large branch factor.
+    //
+    // Children that are exhausted are out of the running until the
+    // whole tree is, so if every child that we know about is
+    // exhausted we have to explore. Only a steer can bring us into an
+    // exhausted subtree before then, and there we choose as if the
+    // whole tree were exhausted.
+    bool prune = !current->Exhausted;
+    std::vector<uint64_t> results;
+    std::vector<double> weights;
+
+    for (auto &t : current->Children) {
+      auto value = t.first;
+      auto &child = t.second;
+      if (child == nullptr || (prune && child->Exhausted))
+        continue;
+      results.push_back(value);
+      weights.push_back(current->weight(value) * child->SizeEstimate);
+    }
 
-    if (explore) {
-      if (current->Weights.size() > 0) {
-        std::discrete_distribution<uint64_t> Dist(current->Weights.begin(),
-                                                  current->Weights.end());
-        while (true) {
-          result = Dist(*G.Rand.get());
-          if (current->Children[result] == nullptr)
-            break;
-        }
+    bool explore = false;
+    if (current->Children.size() < current->BranchFactor) {
+      if (results.empty()) {
+        explore = true;
       } else {
-        std::uniform_int_distribution<uint64_t> Dist(0,
-                                                     current->BranchFactor - 1);
-        while (true) {
-          result = Dist(*G.Rand.get());
-          if (current->Children[result] == nullptr)
-            break;
-        }
+        ExploreStats S{current->BranchFactor, current->Children.size(),
+                       current->Descents,     current->Singletons,
+                       current->KnownMass,    current->ChildMean,
+                       current->ChildVariance};
+        explore = G.Policy->explore(S, *G.Rand);
       }
+    }
 
+    if (explore) {
+      result = current->pickUnexplored(*G.Rand);
       next_node = (current->Children[result] =
                        std::make_unique<WeightedSamplerGuide::Node>())
                       .get();
 
     } else {
+      assert(!results.empty());
+      std::discrete_distribution<size_t> Dist(weights.begin(), weights.end());
+
+      auto i = Dist(*G.Rand.get());
+
+      result = results[i];
+
+      next_node = current->Children[result].get();
+    }
+
+    assert(next_node != nullptr);
+    return this->descend(result);
+  };
+
+  inline uint64_t descend(uint64_t result) {
+    WeightedSamplerGuide::Node *current = this->Trail.back();
+    WeightedSamplerGuide::Node *next_node = current->Children.at(result).get();
+    current->Descents++;
+    next_node->Arrivals++;
+    if (next_node->Arrivals == 1)
+      current->Singletons++;
+    else if (next_node->Arrivals == 2)
+      current->Singletons--;
+
+    this->Trail.push_back(next_node);
+    this->hashChoice(current->BranchFactor, result);
+    return result;
+  }
+
+  inline uint64_t choose(uint64_t Choices) override {
+    std::vector<double> empty;
+    return this->choose(Choices, empty);
+  }
+
+  inline bool flip() override { return choose(2); }
+  inline uint64_t chooseWeighted(const std::vector<double> &) override;
+  inline uint64_t chooseWeighted(const std::vector<uint64_t> &) override;
+  inline uint64_t chooseUnimportant() override;
+  inline void beginScope() override {}
+  inline void endScope() override {}
+};
+
+std::unique_ptr<Chooser> WeightedSamplerGuide::makeChooser() {
+  if (StopWhenExhausted && Root->Exhausted) {
+    if (Verbose)
+      std::cout << "  Tree has been completely explored!\n";
+    return nullptr;
+  }
+  return std::make_unique<WeightedSamplerChooser>(*this);
+}
+
+/*
+ * draw up to K traversals that are guaranteed to end at distinct
+ * leaves, by sequential sampling without replacement over the
+ * estimated tree. each traversal's path is planned from the root
+ * until it either explores (the new child is created right away and
+ * claimed) or reaches a known leaf (which is claimed); below a new
+ * child it continues as usual. a claim removes one leaf's worth of
+ * mass from every node on its path, and a node whose children are all
+ * claimed (and which has nothing left to explore) is claimed too, so
+ * planned paths never share a subtree. fewer than K choosers are
+ * returned if the known tree runs out of distinct leaves
+ */
+std::vector<std::unique_ptr<Chooser>>
+WeightedSamplerGuide::makeChoosers(uint64_t K) {
+  std::vector<std::unique_ptr<Chooser>> Choosers;
+  if (K == 0 || (StopWhenExhausted && Root->Exhausted))
+    return Choosers;
+  // there's nothing to plan from until the first traversal is done
+  if (!Root->visited) {
+    Choosers.push_back(std::make_unique<WeightedSamplerChooser>(*this));
+    return Choosers;
+  }
+  struct Claim {
+    double Taken = 0.0;
+    bool Out = false;
+  };
+  std::unordered_map<Node *, Claim> Claims;
+  bool prune = !Root->Exhausted;
+  auto unavailable = [&](Node *N) {
+    return (prune && N->Exhausted) || Claims[N].Out;
+  };
+  while (Choosers.size() < K && !Claims[Root.get()].Out) {
+    auto C = std::make_unique<WeightedSamplerChooser>(*this);
+    std::vector<Node *> Path{Root.get()};
+    Node *current = Root.get();
+    while (current->visited && current->BranchFactor > 0) {
       std::vector<uint64_t> results;
       std::vector<double> weights;
-
       for (auto &t : current->Children) {
         auto value = t.first;
         auto &child = t.second;
-        if (child == nullptr)
+        if (child == nullptr || unavailable(child.get()))
           continue;
         results.push_back(value);
-        weights.push_back(current->weight(value) * child->SizeEstimate);
+        // never let a subtree's share drop to nothing while it still
+        // has unclaimed leaves, however bad its estimate is
+        weights.push_back(
+            current->weight(value) *
+            std::max(child->SizeEstimate - Claims[child.get()].Taken, 0.5));
+      }
+      bool explore = false;
+      if (current->Children.size() < current->BranchFactor) {
+        if (results.empty()) {
+          explore = true;
+        } else {
+          ExploreStats S{current->BranchFactor, current->Children.size(),
+                         current->Descents,     current->Singletons,
+                         current->KnownMass,    current->ChildMean,
+                         current->ChildVariance};
+          explore = Policy->explore(S, *Rand);
+        }
+      }
+      uint64_t result;
+      if (explore) {
+        result = current->pickUnexplored(*Rand);
+        current->Children[result] = std::make_unique<Node>();
+      } else {
+        assert(!results.empty());
+        std::discrete_distribution<size_t> Dist(weights.begin(),
+                                                weights.end());
+        result = results.at(Dist(*Rand));
       }
+      C->Plan.push_back(result);
+      current = current->Children.at(result).get();
+      Path.push_back(current);
+      if (explore)
+        break;
+    }
+    // claim the end of the path and update everything above it
+    Claims[Path.back()].Out = true;
+    for (auto N : Path)
+      Claims[N].Taken += 1.0;
+    for (auto It = Path.rbegin() + 1; It != Path.rend(); ++It) {
+      auto N = *It;
+      if (N->Children.size() < N->BranchFactor)
+        break;
+      bool AllOut = true;
+      for (auto &t : N->Children)
+        if (t.second != nullptr && !unavailable(t.second.get()))
+          AllOut = false;
+      if (!AllOut)
+        break;
+      Claims[N].Out = true;
+    }
+    Choosers.push_back(std::move(C));
+  }
+  return Choosers;
+}
 
-      std::discrete_distribution<size_t> Dist(weights.begin(), weights.end());
+/*
+ * a steered traversal updates the tree just as an ingested path
+ * does, and once the steer is done it carries on sampling as usual
+ */
+std::unique_ptr<Chooser> WeightedSamplerGuide::makeSteeredChooser(Steer S) {
+  if (StopWhenExhausted && Root->Exhausted)
+    return nullptr;
+  auto C = std::make_unique<WeightedSamplerChooser>(*this);
+  C->Steering = std::move(S);
+  return C;
+}
 
-      auto i = Dist(*G.Rand.get());
+/*
+ * a recorded path is replayed through a planned chooser, so it
+ * updates visit marks, size estimates, exhaustion and the policy
+ * statistics exactly as a traversal of our own would have
+ */
+bool WeightedSamplerGuide::ingest(const std::vector<Step> &Path) {
+  WeightedSamplerChooser C(*this);
+  for (auto &S : Path) {
+    auto current = C.Trail.back();
+    if (S.Choice >= S.Choices ||
+        (current->visited && current->BranchFactor != S.Choices)) {
+      std::cout << "FATAL ERROR: Recorded path doesn't match the tree\n\n";
+      exit(-1);
+    }
+    auto &Child = current->Children[S.Choice];
+    if (!Child)
+      Child = std::make_unique<Node>();
+    C.Plan.push_back(S.Choice);
+    C.choose(S.Choices, S.Weights);
+  }
+  return true;
+}
 
-      result = results[i];
+uint64_t
+WeightedSamplerChooser::chooseWeighted(const std::vector<double> &Probs) {
+  return this->choose(Probs.size(), Probs);
+}
 
-      next_node = current->Children[result].get();
+uint64_t
+WeightedSamplerChooser::chooseWeighted(const std::vector<uint64_t> &Probs) {
+  uint64_t Total = 0;
+  for (auto I : Probs)
+    Total += I;
+  std::vector<double> V;
+  for (auto I : Probs)
+    V.push_back((double)I / Total);
+  return this->choose(Probs.size(), V);
+}
+
+uint64_t WeightedSamplerChooser::chooseUnimportant() {
+  return fullRange(*this->G.Rand);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * BloomGuide: steers traversals towards unvisited edges without
+ * storing the decision tree. a node is identified by a hash of the
+ * path leading to it; we keep a Bloom filter of visited (prefix,
+ * choice) edges and of prefixes whose subtrees appear to be
+ * exhausted, plus small saturating per-prefix counters of visited and
+ * exhausted children. memory use is fixed when the guide is created,
+ * no matter how long it runs. the price is that novelty is only
+ * approximate: a false positive makes an edge look visited (or a
+ * subtree look exhausted) when it isn't, and counter collisions make
+ * a prefix look more explored than it really is. once the estimated
+ * false positive rate exceeds the configured bound we forget
+ * everything and start over, which keeps the rate bounded
+ */
+
+class BloomChooser;
+
+class BloomGuide : public Guide {
+  friend BloomChooser;
+  static const uint64_t DefaultMemory = 1 << 20;
+  static const int NumHashes = 4;
+  // nodes with more children than this are probed randomly instead
+  // of being scanned
+  static const uint64_t MaxScan = 64;
+  static const int MaxProbes = 16;
+  std::vector<uint64_t> Bits;
+  uint64_t NumBits, BitsSet = 0;
+  std::vector<uint8_t> VisitedChildren, ExhaustedChildren;
+  uint64_t CounterMask;
+  double MaxFalsePositiveRate;
+  uint64_t Resets = 0;
+  std::unique_ptr<std::mt19937_64> Rand;
+
+  inline bool test(uint64_t Key);
+  inline void set(uint64_t Key);
+  inline void reset();
+  static uint64_t edgeKey(uint64_t Prefix, uint64_t Choice) {
+    return mix64(Prefix ^ mix64(Choice));
+  }
+  static uint64_t exhaustedKey(uint64_t Prefix) {
+    return mix64(Prefix ^ 0xd1b54a32d192ed03ULL);
+  }
+
+public:
+  inline BloomGuide(uint64_t Seed, uint64_t MemoryBytes = DefaultMemory,
+                    double MaxFPR = 0.01);
+  inline BloomGuide() : BloomGuide(std::random_device{}()) {}
+  inline ~BloomGuide() {}
+  inline std::unique_ptr<Chooser> makeChooser() override;
+  inline const std::string name() override { return "bloom"; }
+  inline double falsePositiveRate();
+  inline uint64_t resets() { return Resets; }
+  // bytes used by the filter and the counter tables
+  inline uint64_t memoryBytes() {
+    return Bits.size() * sizeof(uint64_t) + VisitedChildren.size() +
+           ExhaustedChildren.size();
+  }
+};
+
+class BloomChooser : public Chooser {
+  BloomGuide &G;
+  uint64_t Prefix = 0;
+  // prefix and degree of every node that we've passed through, so
+  // that exhaustion can be propagated upwards at the end
+  std::vector<std::pair<uint64_t, uint64_t>> Trail;
+  inline uint64_t pick(uint64_t, const std::vector<double> &,
+                       std::function<bool(uint64_t)>, bool &);
+
+public:
+  inline BloomChooser(BloomGuide &_G) : G(_G) {}
+  inline ~BloomChooser();
+  inline uint64_t choose(uint64_t Choices, const std::vector<double> &Weights);
+  inline uint64_t choose(uint64_t Choices) override {
+    std::vector<double> empty;
+    return choose(Choices, empty);
+  }
+  inline bool flip() override { return choose(2); }
+  inline uint64_t chooseWeighted(const std::vector<double> &) override;
+  inline uint64_t chooseWeighted(const std::vector<uint64_t> &) override;
+  inline uint64_t chooseUnimportant() override;
+  inline void beginScope() override {}
+  inline void endScope() override {}
+};
+
+BloomGuide::BloomGuide(uint64_t Seed, uint64_t MemoryBytes, double MaxFPR)
+    : MaxFalsePositiveRate(MaxFPR) {
+  // half of the budget goes to the filter and a quarter to each
+  // counter table; everything is rounded down to a power of two
+  uint64_t Words = 1, Counters = 1;
+  while (Words * 2 * sizeof(uint64_t) <= MemoryBytes / 2)
+    Words *= 2;
+  while (Counters * 2 <= MemoryBytes / 4)
+    Counters *= 2;
+  Bits.resize(Words);
+  NumBits = Words * 64;
+  VisitedChildren.resize(Counters);
+  ExhaustedChildren.resize(Counters);
+  CounterMask = Counters - 1;
+  Rand = std::make_unique<std::mt19937_64>(Seed);
+}
+
+std::unique_ptr<Chooser> BloomGuide::makeChooser() {
+  return std::make_unique<BloomChooser>(*this);
+}
+
+bool BloomGuide::test(uint64_t Key) {
+  uint64_t H2 = mix64(Key) | 1;
+  for (int i = 0; i < NumHashes; ++i) {
+    uint64_t B = (Key + i * H2) % NumBits;
+    if (!(Bits.at(B / 64) & (1ULL << (B % 64))))
+      return false;
+  }
+  return true;
+}
+
+void BloomGuide::set(uint64_t Key) {
+  uint64_t H2 = mix64(Key) | 1;
+  for (int i = 0; i < NumHashes; ++i) {
+    uint64_t B = (Key + i * H2) % NumBits;
+    auto &W = Bits.at(B / 64);
+    if (!(W & (1ULL << (B % 64)))) {
+      W |= 1ULL << (B % 64);
+      BitsSet++;
     }
+  }
+}
 
-    assert(next_node != nullptr);
+void BloomGuide::reset() {
+  if (Verbose)
+    std::cout << "Bloom filter is too full, forgetting everything\n";
+  std::fill(Bits.begin(), Bits.end(), 0);
+  std::fill(VisitedChildren.begin(), VisitedChildren.end(), 0);
+  std::fill(ExhaustedChildren.begin(), ExhaustedChildren.end(), 0);
+  BitsSet = 0;
+  Resets++;
+}
 
-    this->Trail.push_back(next_node);
-    return result;
+double BloomGuide::falsePositiveRate() {
+  double Fill = (double)BitsSet / (double)NumBits;
+  double Rate = 1.0;
+  for (int i = 0; i < NumHashes; ++i)
+    Rate *= Fill;
+  return Rate;
+}
+
+/*
+ * pick a child satisfying Wanted, with probability proportional to
+ * its weight; small nodes are scanned and large ones are probed at
+ * random. Found is cleared if nothing suitable turned up
+ */
+uint64_t BloomChooser::pick(uint64_t Choices,
+                            const std::vector<double> &Weights,
+                            std::function<bool(uint64_t)> Wanted,
+                            bool &Found) {
+  Found = true;
+  if (Choices <= BloomGuide::MaxScan) {
+    std::vector<uint64_t> Candidates;
+    std::vector<double> CandidateWeights;
+    for (uint64_t i = 0; i < Choices; ++i) {
+      if (!Wanted(i))
+        continue;
+      if (Weights.size() > 0 && Weights.at(i) <= 0.0)
+        continue;
+      Candidates.push_back(i);
+      CandidateWeights.push_back(Weights.size() > 0 ? Weights.at(i) : 1.0);
+    }
+    if (Candidates.empty()) {
+      Found = false;
+      return 0;
+    }
+    std::discrete_distribution<uint64_t> Dist(CandidateWeights.begin(),
+                                              CandidateWeights.end());
+    return Candidates.at(Dist(*G.Rand));
+  }
+  for (int i = 0; i < BloomGuide::MaxProbes; ++i) {
+    uint64_t Choice;
+    if (Weights.size() > 0) {
+      std::discrete_distribution<uint64_t> Dist(Weights.begin(),
+                                                Weights.end());
+      Choice = Dist(*G.Rand);
+    } else {
+      std::uniform_int_distribution<uint64_t> Dist(0, Choices - 1);
+      Choice = Dist(*G.Rand);
+    }
+    if (Wanted(Choice))
+      return Choice;
+  }
+  Found = false;
+  return 0;
+}
+
+uint64_t BloomChooser::choose(uint64_t Choices,
+                              const std::vector<double> &Weights) {
+  assert(Weights.size() == 0 || Weights.size() == Choices);
+  uint64_t Slot = Prefix & G.CounterMask;
+  bool Found = false;
+  uint64_t Choice = 0;
+  // first preference: an edge that we've never taken
+  if (G.VisitedChildren.at(Slot) < Choices)
+    Choice = pick(
+        Choices, Weights,
+        [&](uint64_t i) { return !G.test(BloomGuide::edgeKey(Prefix, i)); },
+        Found);
+  // second preference: an edge leading to a subtree that still has
+  // something left in it
+  if (!Found)
+    Choice = pick(
+        Choices, Weights,
+        [&](uint64_t i) {
+          return !G.test(
+              BloomGuide::exhaustedKey(BloomGuide::edgeKey(Prefix, i)));
+        },
+        Found);
+  // otherwise we know of nothing new below here
+  if (!Found)
+    Choice = pick(
+        Choices, Weights, [](uint64_t) { return true; }, Found);
+  assert(Found);
+
+  uint64_t Edge = BloomGuide::edgeKey(Prefix, Choice);
+  if (!G.test(Edge)) {
+    G.set(Edge);
+    if (G.VisitedChildren.at(Slot) < 255)
+      G.VisitedChildren.at(Slot)++;
+  }
+  if (Verbose)
+    std::cout << "bloom: prefix " << Prefix << " taking " << Choice << " of "
+              << Choices << "\n";
+  Trail.push_back({Prefix, Choices});
+  Prefix = Edge;
+  hashChoice(Choices, Choice);
+  return Choice;
+}
+
+BloomChooser::~BloomChooser() {
+  // we've reached a leaf, which is trivially exhausted; walk back up
+  // the path marking nodes as exhausted once all of their children
+  // are. counters saturate at 255, so larger nodes never become
+  // exhausted
+  uint64_t Key = BloomGuide::exhaustedKey(Prefix);
+  bool NewlyExhausted = !G.test(Key);
+  G.set(Key);
+  while (NewlyExhausted && !Trail.empty()) {
+    auto [P, Choices] = Trail.back();
+    Trail.pop_back();
+    auto &Count = G.ExhaustedChildren.at(P & G.CounterMask);
+    if (Count < 255)
+      Count++;
+    if (Count < Choices)
+      break;
+    Key = BloomGuide::exhaustedKey(P);
+    NewlyExhausted = !G.test(Key);
+    G.set(Key);
+  }
+  if (G.falsePositiveRate() > G.MaxFalsePositiveRate)
+    G.reset();
+}
+
+uint64_t BloomChooser::chooseWeighted(const std::vector<double> &Probs) {
+  return choose(Probs.size(), Probs);
+}
+
+uint64_t BloomChooser::chooseWeighted(const std::vector<uint64_t> &Probs) {
+  std::vector<double> V(Probs.begin(), Probs.end());
+  return choose(Probs.size(), V);
+}
+
+uint64_t BloomChooser::chooseUnimportant() { return fullRange(*G.Rand); }
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * HybridGuide: exhaustive near the root, estimated sampling further
+ * down. nodes above a depth boundary are stored explicitly, BFS-style,
+ * and we track exactly which of them are exhausted: a traversal always
+ * takes an untaken edge if there is one, and otherwise picks among
+ * children that aren't exhausted in proportion to their size
+ * estimates. each node at the boundary owns a WeightedSamplerGuide for
+ * its subtree; exhaustion stays inside that sampler, and the boundary
+ * node doesn't count as exhausted until it has become an exact node.
+ * whenever every level above the boundary has been completely
+ * enumerated, and we're still within the node budget, the boundary
+ * moves down a level; the samplers at the old boundary are discarded
+ * (their nodes become exact ones) and keep only their size estimates.
+ * so makeChooser() only returns null once the whole tree has been
+ * enumerated exactly. a guide that has run out of node budget with
+ * subtrees still below the boundary never gets there, and keeps
+ * sampling them for as long as it's asked to
+ */
+
+class HybridChooser;
+
+class HybridGuide : public Guide {
+  friend HybridChooser;
+  struct Node {
+    Node *Parent = nullptr;
+    uint64_t Level = 0;
+    bool Visited = false, Exhausted = false;
+    // as in WeightedSamplerGuide, weights are scaled to sum to the
+    // number of children, and are empty when uniform
+    std::vector<double> Weights;
+    std::vector<std::unique_ptr<HybridGuide::Node>> Children;
+    double SizeEstimate = 1.0;
+    // non-null for nodes at the boundary
+    std::unique_ptr<WeightedSamplerGuide> Sub;
+    double weight(uint64_t i) { return Weights.empty() ? 1.0 : Weights.at(i); }
   };
 
-  inline uint64_t choose(uint64_t Choices) override {
-    std::vector<double> empty;
-    return this->choose(Choices, empty);
+  std::unique_ptr<HybridGuide::Node> Root;
+  // the node budget only covers exact nodes; each boundary node's
+  // sampler has a tree of its own
+  uint64_t Boundary, MaxNodes, TotalNodes = 1;
+  // exact nodes that haven't been visited yet, and untaken edges out
+  // of exact nodes; when both are zero, everything above the boundary
+  // has been enumerated
+  uint64_t Unvisited = 1, Untaken = 0;
+  std::unique_ptr<std::mt19937_64> Rand;
+  inline void deepen();
+  inline void convert(Node *N);
+
+public:
+  inline HybridGuide(uint64_t Seed, uint64_t _MaxNodes = 1 << 20,
+                     uint64_t InitialDepth = 1);
+  inline HybridGuide() : HybridGuide(std::random_device{}()) {}
+  inline ~HybridGuide() {}
+  inline std::unique_ptr<Chooser> makeChooser() override;
+  inline void transferFrom(WeightedSamplerGuide &);
+  inline const std::string name() override { return "hybrid"; }
+  inline uint64_t boundary() { return Boundary; }
+  inline uint64_t totalNodes() { return TotalNodes; }
+};
+
+class HybridChooser : public Chooser {
+  HybridGuide &G;
+  std::vector<HybridGuide::Node *> Trail;
+  // once we've crossed the boundary, everything is delegated to this
+  std::unique_ptr<Chooser> SubC;
+
+public:
+  inline HybridChooser(HybridGuide &_G) : G(_G) {
+    Trail.push_back(G.Root.get());
+  }
+  inline ~HybridChooser();
+  inline uint64_t choose(uint64_t Choices, const std::vector<double> &Weights);
+  inline uint64_t choose(uint64_t Choices) override {
+    std::vector<double> empty;
+    return choose(Choices, empty);
+  }
+  inline bool flip() override { return choose(2); }
+  inline uint64_t chooseWeighted(const std::vector<double> &) override;
+  inline uint64_t chooseWeighted(const std::vector<uint64_t> &) override;
+  inline uint64_t chooseUnimportant() override;
+  inline void beginScope() override {
+    if (SubC)
+      SubC->beginScope();
+  }
+  inline void endScope() override {
+    if (SubC)
+      SubC->endScope();
+  }
+};
+
+HybridGuide::HybridGuide(uint64_t Seed, uint64_t _MaxNodes,
+                         uint64_t InitialDepth)
+    : Boundary(InitialDepth), MaxNodes(_MaxNodes) {
+  Root = std::make_unique<HybridGuide::Node>();
+  Rand = std::make_unique<std::mt19937_64>(Seed);
+}
+
+std::unique_ptr<Chooser> HybridGuide::makeChooser() {
+  if (Root->Exhausted) {
+    if (Verbose)
+      std::cout << "  Tree has been completely explored!\n";
+    return nullptr;
+  }
+  return std::make_unique<HybridChooser>(*this);
+}
+
+/*
+ * turn boundary nodes above the (new) boundary into exact nodes
+ */
+void HybridGuide::convert(Node *N) {
+  if (N->Level >= Boundary || TotalNodes >= MaxNodes)
+    return;
+  if (N->Sub) {
+    N->SizeEstimate = N->Sub->sizeEstimate();
+    N->Sub.reset();
+    N->Visited = false;
+    Unvisited++;
+    TotalNodes++;
+    return;
+  }
+  for (auto &C : N->Children)
+    if (C)
+      convert(C.get());
+}
+
+void HybridGuide::deepen() {
+  if (Unvisited != 0 || Untaken != 0 || TotalNodes >= MaxNodes ||
+      Root->Exhausted)
+    return;
+  Boundary++;
+  if (Verbose)
+    std::cout << "hybrid: moving boundary down to " << Boundary << " ("
+              << TotalNodes << " nodes)\n";
+  convert(Root.get());
+}
+
+uint64_t HybridChooser::choose(uint64_t Choices,
+                               const std::vector<double> &Weights) {
+  auto N = Trail.back();
+  if (!SubC && N->Sub)
+    SubC = N->Sub->makeChooser();
+  if (SubC) {
+    auto X = Weights.empty() ? SubC->choose(Choices)
+                             : SubC->chooseWeighted(Weights);
+    hashChoice(Choices, X);
+    return X;
+  }
+
+  if (!N->Visited) {
+    N->Visited = true;
+    G.Unvisited--;
+    N->Children.resize(Choices);
+    G.Untaken += Choices;
+    if (Weights.size() > 0) {
+      double Total = 0.0;
+      for (auto W : Weights)
+        Total += W;
+      for (auto W : Weights)
+        N->Weights.push_back(W / Total * Choices);
+    }
+  } else if (Choices != N->Children.size()) {
+    std::cout << "FATAL ERROR: Reached same node again, but different "
+                 "number of choices this time\n\n";
+    exit(-1);
+  }
+
+  // an untaken edge is always our first preference; otherwise pick
+  // among the children that have something left to explore
+  std::vector<uint64_t> Candidates;
+  std::vector<double> CandidateWeights;
+  for (uint64_t i = 0; i < Choices; ++i)
+    if (!N->Children.at(i)) {
+      Candidates.push_back(i);
+      CandidateWeights.push_back(N->weight(i));
+    }
+  bool Expand = !Candidates.empty();
+  if (!Expand) {
+    for (uint64_t i = 0; i < Choices; ++i) {
+      auto &C = N->Children.at(i);
+      if (C->Exhausted)
+        continue;
+      Candidates.push_back(i);
+      CandidateWeights.push_back(N->weight(i) * C->SizeEstimate);
+    }
+  }
+  assert(!Candidates.empty());
+  double Total = 0.0;
+  for (auto W : CandidateWeights)
+    Total += W;
+  uint64_t Choice;
+  if (Total > 0.0) {
+    std::discrete_distribution<uint64_t> Dist(CandidateWeights.begin(),
+                                              CandidateWeights.end());
+    Choice = Candidates.at(Dist(*G.Rand));
+  } else {
+    std::uniform_int_distribution<uint64_t> Dist(0, Candidates.size() - 1);
+    Choice = Candidates.at(Dist(*G.Rand));
+  }
+
+  if (Expand) {
+    auto C = std::make_unique<HybridGuide::Node>();
+    C->Parent = N;
+    C->Level = N->Level + 1;
+    G.Untaken--;
+    if (C->Level < G.Boundary && G.TotalNodes < G.MaxNodes) {
+      G.Unvisited++;
+      G.TotalNodes++;
+    } else
+      C->Sub = std::make_unique<WeightedSamplerGuide>(fullRange(*G.Rand));
+    N->Children.at(Choice) = std::move(C);
+  }
+  Trail.push_back(N->Children.at(Choice).get());
+  hashChoice(Choices, Choice);
+  return Choice;
+}
+
+HybridChooser::~HybridChooser() {
+  auto Last = Trail.back();
+  if (SubC) {
+    SubC.reset();
+    Last->SizeEstimate = Last->Sub->sizeEstimate();
+  } else {
+    // we stopped at a node without making a choice: it's a leaf
+    if (!Last->Visited && !Last->Sub)
+      G.Unvisited--;
+    Last->Sub.reset();
+    Last->Visited = true;
+    Last->Exhausted = true;
+    Last->SizeEstimate = 1.0;
   }
+  Trail.pop_back();
+  while (!Trail.empty()) {
+    auto N = Trail.back();
+    double Occupied = 0.0, Total = 0.0;
+    bool Exhausted = true;
+    for (uint64_t i = 0; i < N->Children.size(); ++i) {
+      auto &C = N->Children.at(i);
+      if (!C) {
+        Exhausted = false;
+        continue;
+      }
+      if (!C->Exhausted)
+        Exhausted = false;
+      Total += C->SizeEstimate * N->weight(i);
+      Occupied += N->weight(i);
+    }
+    N->SizeEstimate = N->Children.size() * Total / Occupied;
+    N->Exhausted = Exhausted;
+    Trail.pop_back();
+  }
+  G.deepen();
+}
 
-  inline bool flip() override { return choose(2); }
-  inline uint64_t chooseWeighted(const std::vector<double> &) override;
-  inline uint64_t chooseWeighted(const std::vector<uint64_t> &) override;
-  inline uint64_t chooseUnimportant() override;
-  inline void beginScope() override {}
-  inline void endScope() override {}
-};
+uint64_t HybridChooser::chooseWeighted(const std::vector<double> &Probs) {
+  return choose(Probs.size(), Probs);
+}
 
-std::unique_ptr<Chooser> WeightedSamplerGuide::makeChooser() {
-  return std::make_unique<WeightedSamplerChooser>(*this);
+uint64_t HybridChooser::chooseWeighted(const std::vector<uint64_t> &Probs) {
+  std::vector<double> V(Probs.begin(), Probs.end());
+  return choose(Probs.size(), V);
 }
 
-uint64_t
-WeightedSamplerChooser::chooseWeighted(const std::vector<double> &Probs) {
-  return this->choose(Probs.size(), Probs);
+uint64_t HybridChooser::chooseUnimportant() {
+  return SubC ? SubC->chooseUnimportant() : fullRange(*G.Rand);
 }
 
-uint64_t
-WeightedSamplerChooser::chooseWeighted(const std::vector<uint64_t> &Probs) {
-  uint64_t Total = 0;
-  for (auto I : Probs)
-    Total += I;
-  std::vector<double> V;
-  for (auto I : Probs)
-    V.push_back((double)I / Total);
-  return this->choose(Probs.size(), V);
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * transferring state between guides: when a campaign switches
+ * strategies, the new guide can start out from the tree that the old
+ * one has built instead of from nothing. each conversion is a single
+ * pass over the old guide's tree, doesn't run the generator, and
+ * leaves the old guide alone. the new guide must not have been used
+ * yet, and the old one can't have choosers outstanding
+ */
+
+/*
+ * BFS knows every leaf that it has reached, so those leaves, and all
+ * subtrees that it has finished, come over exhausted and with exact
+ * sizes. every BFS traversal ends at a different leaf, which gives
+ * exact visit counts too. BFS doesn't keep the generator's weights,
+ * so nodes come over with uniform weights
+ */
+void WeightedSamplerGuide::transferFrom(BFSGuide &From) {
+  if (Root->visited) {
+    std::cout
+        << "FATAL ERROR: Can't transfer into a guide that's been used\n\n";
+    exit(-1);
+  }
+  assert(From.Outstanding == 0);
+  std::function<void(BFSGuide::Node *, Node *)> Copy =
+      [&](BFSGuide::Node *B, Node *W) {
+        W->visit(B->Children.size());
+        if (B->Children.empty()) {
+          W->Arrivals = 1;
+          return;
+        }
+        for (uint64_t i = 0; i < B->Children.size(); ++i) {
+          auto BC = B->Children.at(i).get();
+          if (!BC)
+            continue;
+          auto &WC = W->Children[i] = std::make_unique<Node>();
+          Copy(BC, WC.get());
+          W->Arrivals += WC->Arrivals;
+          W->Singletons += WC->Arrivals == 1;
+        }
+        W->Descents = W->Arrivals;
+        W->update();
+      };
+  if (From.Root->Children.at(0))
+    Copy(From.Root->Children.at(0).get(), Root.get());
 }
 
-uint64_t WeightedSamplerChooser::chooseUnimportant() {
-  return fullRange(*this->G.Rand);
+/*
+ * best-first search treats every edge that the sampler has taken as
+ * explored, and queues up all of the others in order of probability
+ */
+void BestFirstGuide::transferFrom(WeightedSamplerGuide &From) {
+  if (Started) {
+    std::cout
+        << "FATAL ERROR: Can't transfer into a guide that's been used\n\n";
+    exit(-1);
+  }
+  if (!From.Root->visited)
+    return;
+  Started = true;
+  std::function<void(WeightedSamplerGuide::Node *, Node *)> Copy =
+      [&](WeightedSamplerGuide::Node *W, Node *B) {
+        B->Children.resize(W->BranchFactor);
+        for (auto X : W->Weights)
+          B->Weights.push_back(X / W->BranchFactor);
+        for (auto &t : W->Children) {
+          // a node that was planned but never reached doesn't count
+          if (t.second == nullptr || !t.second->visited)
+            continue;
+          auto C = std::make_unique<Node>();
+          C->Parent = B;
+          C->Prob = B->Prob * B->weight(t.first);
+          Copy(t.second.get(), C.get());
+          B->Children.at(t.first) = std::move(C);
+          TotalNodes++;
+        }
+        push(B);
+      };
+  auto N = std::make_unique<Node>();
+  N->Parent = Root.get();
+  Copy(From.Root.get(), N.get());
+  Root->Children.at(0) = std::move(N);
+  TotalNodes++;
+}
+
+/*
+ * the part of the sampler's tree above our boundary becomes exact
+ * nodes, and each subtree at the boundary is copied into that
+ * boundary node's own sampler. as with our own traversals, a
+ * boundary node isn't exhausted even if its sampler is. after that,
+ * the boundary moves down if everything above it turns out to be
+ * enumerated already
+ */
+void HybridGuide::transferFrom(WeightedSamplerGuide &From) {
+  if (Root->Visited) {
+    std::cout
+        << "FATAL ERROR: Can't transfer into a guide that's been used\n\n";
+    exit(-1);
+  }
+  if (!From.Root->visited)
+    return;
+  std::function<void(WeightedSamplerGuide::Node *, Node *)> Copy =
+      [&](WeightedSamplerGuide::Node *W, Node *H) {
+        if (H->Level >= Boundary ||
+            (H != Root.get() && TotalNodes >= MaxNodes)) {
+          H->Sub = std::make_unique<WeightedSamplerGuide>(fullRange(*Rand));
+          H->Sub->Root = W->clone();
+          H->SizeEstimate = H->Sub->sizeEstimate();
+          return;
+        }
+        if (H != Root.get())
+          TotalNodes++;
+        H->Visited = true;
+        H->Children.resize(W->BranchFactor);
+        H->Weights = W->Weights;
+        if (W->BranchFactor == 0) {
+          H->Exhausted = true;
+          H->SizeEstimate = 1.0;
+          return;
+        }
+        double Occupied = 0.0, Total = 0.0;
+        bool Exhausted = true;
+        for (uint64_t i = 0; i < W->BranchFactor; ++i) {
+          auto It = W->Children.find(i);
+          // a node that was planned but never reached doesn't count
+          if (It == W->Children.end() || It->second == nullptr ||
+              !It->second->visited) {
+            Untaken++;
+            Exhausted = false;
+            continue;
+          }
+          auto C = std::make_unique<Node>();
+          C->Parent = H;
+          C->Level = H->Level + 1;
+          Copy(It->second.get(), C.get());
+          if (!C->Exhausted)
+            Exhausted = false;
+          Total += C->SizeEstimate * H->weight(i);
+          Occupied += H->weight(i);
+          H->Children.at(i) = std::move(C);
+        }
+        H->SizeEstimate =
+            Occupied > 0.0 ? H->Children.size() * Total / Occupied : 1.0;
+        H->Exhausted = Exhausted;
+      };
+  Unvisited = 0;
+  Copy(From.Root.get(), Root.get());
+  deepen();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -712,6 +2321,12 @@ struct rec {
   uint64_t v;
 };
 
+void InterestingValues::harvest(const std::vector<rec> &Choices) {
+  for (auto &R : Choices)
+    if (R.k == RecKind::NUM)
+      add(R.v);
+}
+
 class SaverChooser;
 
 class SaverGuide : public Guide {
@@ -747,6 +2362,7 @@ public:
   inline uint64_t chooseUnimportant() override;
   inline const std::string formatChoices();
   inline std::vector<rec> &getChoices() { return Saved; }
+  inline PathHash pathHash() override { return C->pathHash(); }
   inline void beginScope() override;
   inline void endScope() override;
 };
@@ -831,6 +2447,51 @@ const std::string SaverChooser::formatChoices() {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/*
+ * TracingChooser: wraps a chooser and records the branching decisions
+ * that go through it, along with their arities and weights, as a
+ * path that a guide can ingest. unimportant choices don't branch, so
+ * they aren't recorded
+ */
+
+class TracingChooser : public Chooser {
+  Chooser &C;
+  std::vector<Step> Steps;
+
+public:
+  inline TracingChooser(Chooser &_C) : C(_C) {}
+  inline ~TracingChooser() {}
+  inline uint64_t choose(uint64_t Choices) override {
+    auto X = C.choose(Choices);
+    Steps.push_back({Choices, X, {}});
+    return X;
+  }
+  inline bool flip() override {
+    auto X = C.flip();
+    Steps.push_back({2, X, {}});
+    return X;
+  }
+  inline uint64_t chooseWeighted(const std::vector<double> &Probs) override {
+    auto X = C.chooseWeighted(Probs);
+    Steps.push_back({Probs.size(), X, Probs});
+    return X;
+  }
+  inline uint64_t chooseWeighted(const std::vector<uint64_t> &Probs) override {
+    auto X = C.chooseWeighted(Probs);
+    Steps.push_back({Probs.size(), X, {Probs.begin(), Probs.end()}});
+    return X;
+  }
+  inline uint64_t chooseUnimportant() override {
+    return C.chooseUnimportant();
+  }
+  inline void beginScope() override { C.beginScope(); }
+  inline void endScope() override { C.endScope(); }
+  inline PathHash pathHash() override { return C.pathHash(); }
+  inline const std::vector<Step> &steps() { return Steps; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 /*
  * FileGuide: loads a file of choices; every chooser that it returns
  * does exactly the same thing: makes the choices specified in the
@@ -848,6 +2509,7 @@ class FileGuide : public Guide {
   friend FileChooser;
   std::vector<rec> Choices;
   std::unique_ptr<std::mt19937_64> Rand;
+  ValueSource *Values = nullptr;
   Sync S = Sync::BALANCE;
 
 public:
@@ -858,22 +2520,60 @@ public:
   inline ~FileGuide() {}
   inline std::unique_ptr<Chooser> makeChooser() override;
   inline void setSync(Sync _S) { S = _S; }
+  // where values come from once a chooser runs out of saved choices;
+  // by default, uniformly from the full 64-bit range
+  inline void setValueSource(ValueSource *V) { Values = V; }
   inline const std::string name() override { return "file"; }
   inline bool parseChoices(std::istream &file, const std::string &Prefix);
   inline bool parseChoices(std::string &fileName, const std::string &Prefix);
+  // parse choices from a buffer holding the contents of a choice file,
+  // for example one that has been mapped into memory. these two are
+  // quiet: a malformed input just returns false, and callers that
+  // consider that an error report it themselves
+  inline static bool parseChoices(const char *Buf, size_t Len,
+                                  const std::string &Prefix,
+                                  std::vector<rec> &Out);
+  inline static bool parseChoiceLine(std::string_view Line,
+                                     const std::string &Prefix,
+                                     std::vector<rec> &Out);
   inline std::vector<rec> &getChoices() { return Choices; }
   inline void replaceChoices(const std::vector<rec> &C);
 };
 
 class FileChooser : public Chooser {
   FileGuide &G;
+  // the choices being replayed; the guide's, unless reset() says
+  // otherwise
+  const rec *Begin = nullptr, *End = nullptr;
   std::vector<rec>::size_type Pos = 0;
   inline uint64_t nextVal();
   long FileDepth = 0, GeneratorDepth = 0;
+  uint64_t Divergences = 0;
+  inline std::vector<rec>::size_type length() {
+    return Begin ? End - Begin : G.Choices.size();
+  }
+  inline const rec &at(std::vector<rec>::size_type P) {
+    return Begin ? Begin[P] : G.Choices.at(P);
+  }
 
 public:
   inline FileChooser(FileGuide &_G) : G(_G) {}
   inline ~FileChooser();
+  /*
+   * start over, replaying the choices in [B, E), which must outlive
+   * the replay; this lets one chooser replay many sequences without
+   * copying them into the guide
+   */
+  inline void reset(const rec *B, const rec *E);
+  /*
+   * the number of times that the replay went off the rails: a saved
+   * value that was out of range for the generator's choice, running
+   * out of saved values, or a saved value skipped or avoided while
+   * resynchronizing scopes. saved values that the generator never
+   * asked for are not included; see unconsumed()
+   */
+  inline uint64_t divergences() { return Divergences; }
+  inline uint64_t unconsumed();
   inline uint64_t choose(uint64_t Choices) override;
   inline bool flip() override { return choose(2); }
   inline uint64_t chooseWeighted(const std::vector<double> &) override;
@@ -894,66 +2594,83 @@ std::unique_ptr<Chooser> FileGuide::makeChooser() {
   return std::make_unique<FileChooser>(*this);
 }
 
+void FileChooser::reset(const rec *B, const rec *E) {
+  Begin = B;
+  End = E;
+  Pos = 0;
+  FileDepth = GeneratorDepth = 0;
+  Divergences = 0;
+  resetPathHash();
+}
+
+uint64_t FileChooser::unconsumed() {
+  uint64_t N = 0;
+  for (auto P = Pos; P < length(); ++P)
+    N += at(P).k == RecKind::NUM;
+  return N;
+}
+
 void FileGuide::replaceChoices(const std::vector<rec> &C) {
   Choices.clear();
   for (auto x : C)
     Choices.push_back(x);
 }
 
+bool FileGuide::parseChoiceLine(std::string_view Line,
+                                const std::string &Prefix,
+                                std::vector<rec> &Out) {
+  auto PrefixLen = Prefix.size();
+  if (Line.compare(0, PrefixLen, Prefix) != 0)
+    return false;
+  uint64_t val = 0;
+  RecKind k = tree_guide::RecKind::NONE;
+  for (std::string::size_type pos = PrefixLen; pos < Line.length(); ++pos) {
+    auto c = Line[pos];
+    if (c == ',') {
+      rec r;
+      switch (k) {
+      case tree_guide::RecKind::NUM:
+        r.v = val;
+        val = 0;
+        break;
+      case tree_guide::RecKind::START:
+        break;
+      case tree_guide::RecKind::END:
+        break;
+      default:
+        assert(false);
+      }
+      r.k = k;
+      Out.push_back(r);
+      k = tree_guide::RecKind::NONE;
+    } else if (c >= '0' && c <= '9') {
+      // TODO check for integer overflow here, that could happen
+      // if a choice sequence file got corrupted
+      val *= 10;
+      val += c - '0';
+      k = tree_guide::RecKind::NUM;
+    } else if (c == '{') {
+      k = tree_guide::RecKind::START;
+    } else if (c == '}') {
+      k = tree_guide::RecKind::END;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool FileGuide::parseChoices(std::istream &file, const std::string &Prefix) {
   std::string line;
   bool inData = false;
-  auto PrefixLen = Prefix.size();
   while (std::getline(file, line)) {
     if (inData) {
-      if (line == (Prefix + EndMarker)) {
+      if (line == (Prefix + EndMarker))
         break;
-      } else {
-        if (line.compare(0, PrefixLen, Prefix) != 0) {
-          std::cerr << "FATAL ERROR: Expected every line of choices to start "
-                       "with '"
-                    << Prefix << "'\n\n";
-          return false;
-        }
-        uint64_t val = 0;
-        RecKind k = tree_guide::RecKind::NONE;
-        for (std::string::size_type pos = PrefixLen; pos < line.length();
-             ++pos) {
-          auto c = line[pos];
-          if (c == ',') {
-            rec r;
-            switch (k) {
-            case tree_guide::RecKind::NUM:
-              r.v = val;
-              val = 0;
-              break;
-            case tree_guide::RecKind::START:
-              break;
-            case tree_guide::RecKind::END:
-              break;
-            default:
-              assert(false);
-            }
-            r.k = k;
-            Choices.push_back(r);
-            k = tree_guide::RecKind::NONE;
-          } else if (c >= '0' && c <= '9') {
-            // TODO check for integer overflow here, that could happen
-            // if a choice sequence file got corrupted
-            val *= 10;
-            val += c - '0';
-            k = tree_guide::RecKind::NUM;
-          } else if (c == '{') {
-            k = tree_guide::RecKind::START;
-          } else if (c == '}') {
-            k = tree_guide::RecKind::END;
-          } else {
-            std::cerr << "FATAL ERROR: Illegal character '" << c
-                      << "' in choice string\n\n";
-            std::cerr << "line: '" << line << "'\n";
-            return false;
-          }
-        }
+      if (!parseChoiceLine(line, Prefix, Choices)) {
+        std::cerr << "FATAL ERROR: Malformed line of choices: '" << line
+                  << "'\n\n";
+        return false;
       }
     } else {
       if (line.find(Prefix + StartMarker) != std::string::npos)
@@ -967,6 +2684,30 @@ bool FileGuide::parseChoices(std::istream &file, const std::string &Prefix) {
   return true;
 }
 
+bool FileGuide::parseChoices(const char *Buf, size_t Len,
+                             const std::string &Prefix,
+                             std::vector<rec> &Out) {
+  std::string_view Rest(Buf, Len);
+  const auto Start = Prefix + StartMarker, Stop = Prefix + EndMarker;
+  auto OldSize = Out.size();
+  bool inData = false;
+  while (!Rest.empty()) {
+    auto NL = Rest.find('\n');
+    auto Line = Rest.substr(0, NL);
+    Rest.remove_prefix(NL == std::string_view::npos ? Rest.size() : NL + 1);
+    if (inData) {
+      if (Line == Stop)
+        break;
+      if (!parseChoiceLine(Line, Prefix, Out))
+        return false;
+    } else {
+      if (Line.find(Start) != std::string_view::npos)
+        inData = true;
+    }
+  }
+  return Out.size() != OldSize;
+}
+
 bool FileGuide::parseChoices(std::string &FileName, const std::string &Prefix) {
   std::ifstream file(FileName);
   if (!file.is_open()) {
@@ -1001,7 +2742,7 @@ FileChooser::~FileChooser() {
     }
     // often there's (at least) an end scope still sitting there, we
     // need to process it
-    while (Pos < G.Choices.size())
+    while (Pos < length())
       nextVal();
     if (FileDepth != 0) {
       std::cerr << "FATAL ERROR: Unbalanced scopes from file with depth "
@@ -1016,13 +2757,14 @@ again:
 
   // if we've exhausted the choice sequence from disk, we have no
   // choice besides returning randomness
-  if (Pos >= G.Choices.size()) {
+  if (Pos >= length()) {
     if (Verbose)
       std::cerr << "Choice sequence exhausted, returning randomness\n";
-    return fullRange(*G.Rand.get());
+    ++Divergences;
+    return G.Values ? G.Values->next(*G.Rand) : fullRange(*G.Rand.get());
   }
 
-  auto r = G.Choices.at(Pos);
+  auto r = at(Pos);
 
   // next we give the file guide a chance to catch up with the scoping
   // level of the generator
@@ -1063,7 +2805,8 @@ again:
 
   // we want to avoid returning choices from the file
   if (FileDepth < GeneratorDepth) {
-    auto v = fullRange(*G.Rand.get());
+    ++Divergences;
+    auto v = G.Values ? G.Values->next(*G.Rand) : fullRange(*G.Rand.get());
     if (Verbose)
       std::cerr << "Avoiding saved choice and returning random: " << v << "\n";
     return v;
@@ -1073,6 +2816,7 @@ again:
   if (FileDepth > GeneratorDepth) {
     if (Verbose)
       std::cerr << "Discarding saved choice\n";
+    ++Divergences;
     ++Pos;
     goto again;
   }
@@ -1080,20 +2824,305 @@ again:
   assert(false);
 }
 
-uint64_t FileChooser::choose(uint64_t Choices) { return nextVal() % Choices; }
+uint64_t FileChooser::choose(uint64_t Choices) {
+  auto V = nextVal();
+  Divergences += V >= Choices;
+  auto X = V % Choices;
+  hashChoice(Choices, X);
+  return X;
+}
 
 uint64_t FileChooser::chooseWeighted(const std::vector<double> &Probs) {
-  return nextVal() % Probs.size();
+  auto V = nextVal();
+  Divergences += V >= Probs.size();
+  auto X = V % Probs.size();
+  hashChoice(Probs.size(), X);
+  return X;
 }
 
 uint64_t FileChooser::chooseWeighted(const std::vector<uint64_t> &Probs) {
-  return nextVal() % Probs.size();
+  auto V = nextVal();
+  Divergences += V >= Probs.size();
+  auto X = V % Probs.size();
+  hashChoice(Probs.size(), X);
+  return X;
 }
 
 uint64_t FileChooser::chooseUnimportant() { return nextVal(); }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/*
+ * CorpusGuide: seeds exploration from a corpus of saved choice
+ * sequences, such as test cases that reached new coverage. the
+ * sequences live in a compressed prefix trie, so entries that share a
+ * prefix share its storage. each chooser samples an entry in
+ * proportion to its score, replays a prefix of it, and from the cut
+ * point on makes its choices using a chooser from the inner guide, or
+ * randomly if there isn't one. higher-scoring entries are picked more
+ * often and also cut later, keeping more of what made them
+ * productive. as in FileGuide, replayed values are reduced modulo the
+ * number of choices, and scopes are ignored.
+ *
+ * the inner guide's choosers always start at the root: the prefix is
+ * replayed through a steered chooser (see Guide::makeSteeredChooser),
+ * so a guide that keeps a tree sees the whole path. an inner guide
+ * that can't be steered only gets the traversals whose prefix is
+ * empty, and the others continue randomly
+ */
+
+class CorpusChooser;
+
+class CorpusGuide : public Guide {
+  friend CorpusChooser;
+  struct Node {
+    Node *Parent = nullptr;
+    // the values along the edge leading into this node
+    std::vector<uint64_t> Label;
+    std::unordered_map<uint64_t, std::unique_ptr<Node>> Children;
+  };
+  struct Entry {
+    Node *End;
+    uint64_t Length;
+    double Score;
+  };
+
+  std::unique_ptr<Node> Root;
+  std::vector<Entry> Entries;
+  double TotalScore = 0.0;
+  uint64_t StoredValues = 0, NumNodes = 1;
+  Guide *InnerG;
+  std::unique_ptr<std::mt19937_64> Rand;
+  inline Node *insert(const std::vector<uint64_t> &);
+  inline std::vector<uint64_t> prefix(const Entry &, uint64_t Cut);
+
+public:
+  inline CorpusGuide(uint64_t Seed, Guide *_InnerG = nullptr)
+      : InnerG(_InnerG) {
+    Root = std::make_unique<Node>();
+    Rand = std::make_unique<std::mt19937_64>(Seed);
+  }
+  inline CorpusGuide() : CorpusGuide(std::random_device{}()) {}
+  inline ~CorpusGuide() {}
+  inline std::unique_ptr<Chooser> makeChooser() override;
+  inline const std::string name() override {
+    return InnerG ? "corpus (continued by " + InnerG->name() + ")" : "corpus";
+  }
+  // add a choice sequence as saved by SaverGuide; returns its index
+  inline size_t addEntry(const std::vector<rec> &Choices, double Score = 1.0);
+  // add a choice sequence from a file in SaverGuide's format
+  inline bool addEntry(std::istream &File, const std::string &Prefix,
+                       double Score = 1.0);
+  inline void setScore(size_t Index, double Score);
+  inline size_t entries() { return Entries.size(); }
+  // total number of values stored in the trie
+  inline uint64_t storedValues() { return StoredValues; }
+  inline uint64_t trieNodes() { return NumNodes; }
+};
+
+class CorpusChooser : public Chooser {
+  CorpusGuide &G;
+  std::vector<uint64_t> Prefix;
+  size_t Pos = 0;
+  std::unique_ptr<Chooser> InnerC;
+
+public:
+  inline CorpusChooser(CorpusGuide &_G, std::vector<uint64_t> _Prefix);
+  inline ~CorpusChooser() {}
+  inline uint64_t choose(uint64_t Choices) override;
+  inline bool flip() override { return choose(2); }
+  inline uint64_t chooseWeighted(const std::vector<double> &) override;
+  inline uint64_t chooseWeighted(const std::vector<uint64_t> &) override;
+  inline uint64_t chooseUnimportant() override;
+  inline void beginScope() override {
+    if (InnerC)
+      InnerC->beginScope();
+  }
+  inline void endScope() override {
+    if (InnerC)
+      InnerC->endScope();
+  }
+};
+
+/*
+ * add a sequence to the trie, splitting an edge if the sequence
+ * leaves it partway along; the node below a split keeps its identity,
+ * so entries that end there are unaffected
+ */
+CorpusGuide::Node *CorpusGuide::insert(const std::vector<uint64_t> &Values) {
+  Node *N = Root.get();
+  size_t i = 0;
+  while (i < Values.size()) {
+    auto It = N->Children.find(Values.at(i));
+    if (It == N->Children.end()) {
+      auto C = std::make_unique<Node>();
+      C->Parent = N;
+      C->Label.assign(Values.begin() + i, Values.end());
+      StoredValues += C->Label.size();
+      NumNodes++;
+      auto Res = C.get();
+      N->Children[Values.at(i)] = std::move(C);
+      return Res;
+    }
+    auto C = It->second.get();
+    size_t k = 0;
+    while (k < C->Label.size() && i + k < Values.size() &&
+           C->Label.at(k) == Values.at(i + k))
+      ++k;
+    if (k < C->Label.size()) {
+      auto M = std::make_unique<Node>();
+      M->Parent = N;
+      M->Label.assign(C->Label.begin(), C->Label.begin() + k);
+      C->Label.erase(C->Label.begin(), C->Label.begin() + k);
+      C->Parent = M.get();
+      M->Children[C->Label.front()] = std::move(It->second);
+      It->second = std::move(M);
+      NumNodes++;
+      C = It->second.get();
+    }
+    N = C;
+    i += k;
+  }
+  return N;
+}
+
+std::vector<uint64_t> CorpusGuide::prefix(const Entry &E, uint64_t Cut) {
+  std::vector<const std::vector<uint64_t> *> Labels;
+  for (Node *N = E.End; N != Root.get(); N = N->Parent)
+    Labels.push_back(&N->Label);
+  std::vector<uint64_t> Values;
+  Values.reserve(E.Length);
+  for (auto It = Labels.rbegin(); It != Labels.rend(); ++It)
+    Values.insert(Values.end(), (*It)->begin(), (*It)->end());
+  Values.resize(Cut);
+  return Values;
+}
+
+size_t CorpusGuide::addEntry(const std::vector<rec> &Choices, double Score) {
+  std::vector<uint64_t> Values;
+  for (auto &R : Choices)
+    if (R.k == RecKind::NUM)
+      Values.push_back(R.v);
+  Entries.push_back({insert(Values), Values.size(), Score});
+  TotalScore += Score;
+  return Entries.size() - 1;
+}
+
+bool CorpusGuide::addEntry(std::istream &File, const std::string &Prefix,
+                           double Score) {
+  FileGuide FG;
+  if (!FG.parseChoices(File, Prefix))
+    return false;
+  addEntry(FG.getChoices(), Score);
+  return true;
+}
+
+void CorpusGuide::setScore(size_t Index, double Score) {
+  auto &E = Entries.at(Index);
+  TotalScore += Score - E.Score;
+  E.Score = Score;
+}
+
+std::unique_ptr<Chooser> CorpusGuide::makeChooser() {
+  if (Entries.empty())
+    return std::make_unique<CorpusChooser>(*this, std::vector<uint64_t>());
+  // pick an entry in proportion to its score
+  size_t Index = 0;
+  if (TotalScore > 0.0) {
+    std::uniform_real_distribution<double> Dist(0.0, TotalScore);
+    double X = Dist(*Rand);
+    while (Index + 1 < Entries.size() && X >= Entries.at(Index).Score) {
+      X -= Entries.at(Index).Score;
+      ++Index;
+    }
+  } else {
+    std::uniform_int_distribution<size_t> Dist(0, Entries.size() - 1);
+    Index = Dist(*Rand);
+  }
+  auto &E = Entries.at(Index);
+  // the cut point is uniform for an entry with a score of zero, and
+  // moves towards the end as its score rises above the mean
+  double Relative =
+      TotalScore > 0.0 ? E.Score * Entries.size() / TotalScore : 0.0;
+  std::uniform_real_distribution<double> Unif(0.0, 1.0);
+  auto Cut = std::min(
+      E.Length,
+      (uint64_t)((E.Length + 1) * pow(Unif(*Rand), 1.0 / (1.0 + Relative))));
+  if (Verbose)
+    std::cout << "corpus: entry " << Index << ", replaying " << Cut << " of "
+              << E.Length << " choices\n";
+  return std::make_unique<CorpusChooser>(*this, prefix(E, Cut));
+}
+
+CorpusChooser::CorpusChooser(CorpusGuide &_G, std::vector<uint64_t> _Prefix)
+    : G(_G), Prefix(std::move(_Prefix)) {
+  if (!G.InnerG)
+    return;
+  if (Prefix.empty()) {
+    InnerC = G.InnerG->makeChooser();
+    return;
+  }
+  InnerC = G.InnerG->makeSteeredChooser([this](uint64_t Choices,
+                                               uint64_t &Choice) {
+    if (Pos >= Prefix.size())
+      return false;
+    Choice = Prefix.at(Pos++) % Choices;
+    return true;
+  });
+}
+
+uint64_t CorpusChooser::choose(uint64_t Choices) {
+  uint64_t X;
+  if (InnerC) {
+    X = InnerC->choose(Choices);
+  } else if (Pos < Prefix.size()) {
+    X = Prefix.at(Pos++) % Choices;
+  } else {
+    std::uniform_int_distribution<uint64_t> Dist(0, Choices - 1);
+    X = Dist(*G.Rand);
+  }
+  hashChoice(Choices, X);
+  return X;
+}
+
+uint64_t CorpusChooser::chooseWeighted(const std::vector<double> &Probs) {
+  uint64_t X;
+  if (InnerC) {
+    X = InnerC->chooseWeighted(Probs);
+  } else if (Pos < Prefix.size()) {
+    X = Prefix.at(Pos++) % Probs.size();
+  } else {
+    std::discrete_distribution<uint64_t> Dist(Probs.begin(), Probs.end());
+    X = Dist(*G.Rand);
+  }
+  hashChoice(Probs.size(), X);
+  return X;
+}
+
+uint64_t CorpusChooser::chooseWeighted(const std::vector<uint64_t> &Probs) {
+  uint64_t X;
+  if (InnerC) {
+    X = InnerC->chooseWeighted(Probs);
+  } else if (Pos < Prefix.size()) {
+    X = Prefix.at(Pos++) % Probs.size();
+  } else {
+    std::discrete_distribution<uint64_t> Dist(Probs.begin(), Probs.end());
+    X = Dist(*G.Rand);
+  }
+  hashChoice(Probs.size(), X);
+  return X;
+}
+
+uint64_t CorpusChooser::chooseUnimportant() {
+  if (Pos < Prefix.size())
+    return Prefix.at(Pos++);
+  if (InnerC)
+    return InnerC->chooseUnimportant();
+  return fullRange(*G.Rand);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 /*
  * RRGuide: creates choosers from multiple guides in round-robin
  * fashion
@@ -1141,6 +3170,7 @@ public:
   inline uint64_t chooseWeighted(const std::vector<uint64_t> &) override;
   inline uint64_t chooseUnimportant() override;
   inline bool hasSubChooser() { return C != nullptr; }
+  inline PathHash pathHash() override { return C->pathHash(); }
   inline void beginScope() override { C->beginScope(); }
   inline void endScope() override { C->endScope(); }
 };
@@ -1167,6 +3197,212 @@ std::unique_ptr<Chooser> RRGuide::makeChooser() {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/*
+ * CuckooFilter: a fixed-size approximate set of path hashes, storing
+ * a 16-bit fingerprint in one of two candidate buckets of four slots
+ * each. there are no false negatives unless the filter overflows, in
+ * which case a displaced fingerprint is dropped (and counted) rather
+ * than growing the table; the false positive rate is at most about
+ * 8 in 65536
+ */
+
+class CuckooFilter {
+  static const uint64_t SlotsPerBucket = 4;
+  static const int MaxKicks = 500;
+  std::vector<uint16_t> Slots;
+  uint64_t BucketMask;
+  uint64_t Count = 0, Dropped = 0;
+  std::mt19937_64 Rand;
+
+  inline static uint16_t fingerprint(const PathHash &H) {
+    // zero marks an empty slot
+    uint16_t F = H.Hi >> 48;
+    return F ? F : 1;
+  }
+  inline uint64_t altBucket(uint64_t B, uint16_t F) {
+    return (B ^ mix64(F)) & BucketMask;
+  }
+  inline bool inBucket(uint64_t B, uint16_t F);
+  inline bool addToBucket(uint64_t B, uint16_t F);
+
+public:
+  inline CuckooFilter(uint64_t Capacity, uint64_t Seed = 0);
+  inline bool contains(const PathHash &H);
+  // returns false if H was (probably) already present
+  inline bool insert(const PathHash &H);
+  inline uint64_t size() { return Count; }
+  inline uint64_t dropped() { return Dropped; }
+};
+
+CuckooFilter::CuckooFilter(uint64_t Capacity, uint64_t Seed) : Rand(Seed) {
+  // aim for a load factor of at most 95%
+  uint64_t Buckets = 1;
+  while (Buckets * SlotsPerBucket * 95 < Capacity * 100)
+    Buckets *= 2;
+  BucketMask = Buckets - 1;
+  Slots.resize(Buckets * SlotsPerBucket);
+}
+
+bool CuckooFilter::inBucket(uint64_t B, uint16_t F) {
+  for (uint64_t i = 0; i < SlotsPerBucket; ++i)
+    if (Slots.at(B * SlotsPerBucket + i) == F)
+      return true;
+  return false;
+}
+
+bool CuckooFilter::addToBucket(uint64_t B, uint16_t F) {
+  for (uint64_t i = 0; i < SlotsPerBucket; ++i) {
+    auto &S = Slots.at(B * SlotsPerBucket + i);
+    if (S == 0) {
+      S = F;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CuckooFilter::contains(const PathHash &H) {
+  auto F = fingerprint(H);
+  auto B = H.Lo & BucketMask;
+  return inBucket(B, F) || inBucket(altBucket(B, F), F);
+}
+
+bool CuckooFilter::insert(const PathHash &H) {
+  if (contains(H))
+    return false;
+  auto F = fingerprint(H);
+  auto B = H.Lo & BucketMask;
+  ++Count;
+  if (addToBucket(B, F) || addToBucket(altBucket(B, F), F))
+    return true;
+  // both buckets are full: evict fingerprints until one of them
+  // finds a home
+  std::uniform_int_distribution<uint64_t> Dist(0, SlotsPerBucket - 1);
+  if (Rand() & 1)
+    B = altBucket(B, F);
+  for (int Kick = 0; Kick < MaxKicks; ++Kick) {
+    std::swap(F, Slots.at(B * SlotsPerBucket + Dist(Rand)));
+    B = altBucket(B, F);
+    if (addToBucket(B, F))
+      return true;
+  }
+  --Count;
+  ++Dropped;
+  return true;
+}
+
+/*
+ * DedupGuide: wraps another guide, remembering the path hashes of
+ * completed traversals in a cuckoo filter. after running the
+ * generator, but before handing its output to the system under test,
+ * ask the chooser isDuplicate(); or let generateUnique() retry until
+ * it gets a path that hasn't been seen
+ */
+
+class DedupChooser;
+
+class DedupGuide : public Guide {
+  friend DedupChooser;
+  Guide *SubG;
+  CuckooFilter Seen;
+  uint64_t Duplicates = 0;
+
+public:
+  inline DedupGuide(uint64_t Seed) = delete;
+  inline DedupGuide() = delete;
+  inline DedupGuide(Guide *_SubG, uint64_t Capacity = 1 << 20)
+      : SubG(_SubG), Seen(Capacity) {}
+  inline ~DedupGuide() {}
+  inline std::unique_ptr<Chooser> makeChooser() override;
+  // both are passed on to the wrapped guide; an ingested path also
+  // counts as seen, so traversals that repeat it are duplicates
+  inline bool ingest(const std::vector<Step> &) override;
+  inline std::unique_ptr<Chooser> makeSteeredChooser(Steer) override;
+  inline const std::string name() override {
+    return SubG->name() + " (wrapped by Dedup)";
+  }
+  // number of completed traversals whose path had already been seen
+  inline uint64_t duplicates() { return Duplicates; }
+  template <typename T>
+  std::optional<T> generateUnique(const std::function<T(Chooser &)> &Gen,
+                                  uint64_t MaxTries);
+};
+
+class DedupChooser : public Chooser {
+  DedupGuide &G;
+  std::unique_ptr<Chooser> C;
+
+public:
+  inline DedupChooser(DedupGuide &_G, std::unique_ptr<Chooser> _C)
+      : G(_G), C(std::move(_C)) {}
+  inline ~DedupChooser() {
+    if (!G.Seen.insert(pathHash()))
+      G.Duplicates++;
+  }
+  inline uint64_t choose(uint64_t Choices) override {
+    return C->choose(Choices);
+  }
+  inline bool flip() override { return C->flip(); }
+  inline uint64_t chooseWeighted(const std::vector<double> &Probs) override {
+    return C->chooseWeighted(Probs);
+  }
+  inline uint64_t chooseWeighted(const std::vector<uint64_t> &Probs) override {
+    return C->chooseWeighted(Probs);
+  }
+  inline uint64_t chooseUnimportant() override {
+    return C->chooseUnimportant();
+  }
+  inline void beginScope() override { C->beginScope(); }
+  inline void endScope() override { C->endScope(); }
+  inline PathHash pathHash() override { return C->pathHash(); }
+  // has a traversal with the same path already completed?
+  inline bool isDuplicate() { return G.Seen.contains(pathHash()); }
+};
+
+std::unique_ptr<Chooser> DedupGuide::makeChooser() {
+  auto C = SubG->makeChooser();
+  if (!C)
+    return nullptr;
+  return std::make_unique<DedupChooser>(*this, std::move(C));
+}
+
+bool DedupGuide::ingest(const std::vector<Step> &Path) {
+  PathHash H;
+  for (auto &S : Path)
+    H.add(S.Choices, S.Choice);
+  Seen.insert(H);
+  return SubG->ingest(Path);
+}
+
+std::unique_ptr<Chooser> DedupGuide::makeSteeredChooser(Steer S) {
+  auto C = SubG->makeSteeredChooser(std::move(S));
+  if (!C)
+    return nullptr;
+  return std::make_unique<DedupChooser>(*this, std::move(C));
+}
+
+/*
+ * run the generator until it takes a path that we haven't seen
+ * before, giving up after MaxTries attempts or when the wrapped guide
+ * runs out of choosers
+ */
+template <typename T>
+std::optional<T>
+DedupGuide::generateUnique(const std::function<T(Chooser &)> &Gen,
+                           uint64_t MaxTries) {
+  for (uint64_t i = 0; i < MaxTries; ++i) {
+    auto C = makeChooser();
+    if (!C)
+      return {};
+    auto Result = Gen(*C);
+    if (!static_cast<DedupChooser *>(C.get())->isDuplicate())
+      return Result;
+  }
+  return {};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 /*
  * remote guide: ephemeral in-process guide that talks to a different
  * guide living in a server process; use this for generators that can
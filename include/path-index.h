@@ -0,0 +1,169 @@
+#ifndef TREE_GUIDE_PATH_INDEX_H_
+#define TREE_GUIDE_PATH_INDEX_H_
+
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "guide.h"
+
+namespace tree_guide {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * PathIndex: a trie of the decision paths that we've seen, built from
+ * saved choice sequences, for tools that sit outside the generator
+ * and never get to see its arities (such as the AFL++ plugin). the
+ * sequences have to be the ones that the generator saved, so that
+ * every value is already in range: two such sequences are the same
+ * path exactly when their values are the same. for a deterministic
+ * generator the values also determine the scopes, so those are
+ * ignored. each node counts how many indexed paths go through it and
+ * how many of its children have been seen exactly once, which gives a
+ * Good-Turing estimate of how likely a different choice at that point
+ * is to go somewhere new
+ */
+
+class PathIndex {
+public:
+  struct Node {
+    // value -> node
+    std::unordered_map<uint64_t, uint64_t> Children;
+    // paths that go through or end at this node
+    uint64_t Visits = 0;
+    // children that have been visited exactly once
+    uint64_t Singletons = 0;
+    // paths that end here
+    uint64_t Ends = 0;
+  };
+
+private:
+  std::vector<Node> Nodes;
+  uint64_t Paths = 0;
+
+public:
+  inline PathIndex() { Nodes.emplace_back(); }
+  /*
+   * add a path, returning its id and whether we hadn't seen it before
+   */
+  inline std::pair<uint64_t, bool> insert(const std::vector<rec> &Choices);
+  inline std::optional<uint64_t> find(const std::vector<rec> &Choices) const;
+  /*
+   * for each value in the sequence, the estimated probability that
+   * choosing differently at that point leads somewhere that isn't in
+   * the index; it's 1 wherever the sequence has left the index
+   */
+  inline std::vector<double> novelty(const std::vector<rec> &Choices) const;
+  /*
+   * the mean novelty: how likely changing one value, picked at
+   * random, is to lead somewhere new
+   */
+  inline double meanNovelty(const std::vector<rec> &Choices) const;
+  /*
+   * for each value in the sequence, the node that it was chosen at,
+   * stopping where the sequence leaves the index
+   */
+  inline std::vector<uint64_t> walk(const std::vector<rec> &Choices) const;
+  inline const Node &node(uint64_t N) const { return Nodes.at(N); }
+  // distinct paths and trie nodes
+  inline uint64_t paths() const { return Paths; }
+  inline uint64_t nodes() const { return Nodes.size(); }
+};
+
+std::pair<uint64_t, bool> PathIndex::insert(const std::vector<rec> &Choices) {
+  uint64_t N = 0;
+  Nodes.at(N).Visits++;
+  for (auto &R : Choices) {
+    if (R.k != RecKind::NUM)
+      continue;
+    auto It = Nodes.at(N).Children.find(R.v);
+    uint64_t Child;
+    if (It == Nodes.at(N).Children.end()) {
+      Child = Nodes.size();
+      Nodes.at(N).Children.emplace(R.v, Child);
+      Nodes.emplace_back();
+    } else {
+      Child = It->second;
+    }
+    auto Visits = ++Nodes.at(Child).Visits;
+    if (Visits == 1)
+      Nodes.at(N).Singletons++;
+    else if (Visits == 2)
+      Nodes.at(N).Singletons--;
+    N = Child;
+  }
+  bool New = Nodes.at(N).Ends++ == 0;
+  Paths += New;
+  return {N, New};
+}
+
+std::optional<uint64_t> PathIndex::find(const std::vector<rec> &Choices) const {
+  uint64_t N = 0;
+  for (auto &R : Choices) {
+    if (R.k != RecKind::NUM)
+      continue;
+    auto It = Nodes.at(N).Children.find(R.v);
+    if (It == Nodes.at(N).Children.end())
+      return {};
+    N = It->second;
+  }
+  if (Nodes.at(N).Ends == 0)
+    return {};
+  return N;
+}
+
+std::vector<double> PathIndex::novelty(const std::vector<rec> &Choices) const {
+  std::vector<double> Result;
+  std::optional<uint64_t> N = 0;
+  for (auto &R : Choices) {
+    if (R.k != RecKind::NUM)
+      continue;
+    if (!N) {
+      Result.push_back(1.0);
+      continue;
+    }
+    auto &Cur = Nodes.at(*N);
+    Result.push_back(Cur.Visits == 0
+                         ? 1.0
+                         : (double)Cur.Singletons / (double)Cur.Visits);
+    auto It = Cur.Children.find(R.v);
+    if (It == Cur.Children.end())
+      N.reset();
+    else
+      N = It->second;
+  }
+  return Result;
+}
+
+double PathIndex::meanNovelty(const std::vector<rec> &Choices) const {
+  auto N = novelty(Choices);
+  if (N.empty())
+    return 0.0;
+  double Total = 0.0;
+  for (auto X : N)
+    Total += X;
+  return Total / N.size();
+}
+
+std::vector<uint64_t> PathIndex::walk(const std::vector<rec> &Choices) const {
+  std::vector<uint64_t> Result;
+  uint64_t N = 0;
+  for (auto &R : Choices) {
+    if (R.k != RecKind::NUM)
+      continue;
+    Result.push_back(N);
+    auto It = Nodes.at(N).Children.find(R.v);
+    if (It == Nodes.at(N).Children.end())
+      break;
+    N = It->second;
+  }
+  return Result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace tree_guide
+
+#endif
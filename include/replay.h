@@ -0,0 +1,207 @@
+#ifndef TREE_GUIDE_REPLAY_H_
+#define TREE_GUIDE_REPLAY_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "corpus-store.h"
+#include "guide.h"
+
+namespace tree_guide {
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * bulk replay of saved choice sequences, for regenerating a whole
+ * corpus after the generator changes. a ReplayCorpus gathers the
+ * sequences, from choice files or a CorpusStore, into one contiguous
+ * arena; replay() then runs the generator over all of them using a
+ * pool of threads, each of which reuses a single FileChooser, and
+ * reports throughput along with the sequences whose replay diverged
+ */
+
+class ReplayCorpus {
+  std::vector<rec> Arena;
+  // [begin, end) offsets into the arena
+  std::vector<std::pair<uint64_t, uint64_t>> Spans;
+  std::vector<std::string> Names;
+
+public:
+  inline void add(const std::vector<rec> &Choices,
+                  const std::string &Name = "");
+  // parse a choice file in SaverGuide's format
+  inline bool addFile(const std::string &FileName, const std::string &Prefix);
+  inline void addStore(CorpusStore &Store);
+  inline uint64_t size() const { return Spans.size(); }
+  inline uint64_t totalChoices() const { return Arena.size(); }
+  inline const std::string &name(uint64_t I) const { return Names.at(I); }
+  inline const rec *begin(uint64_t I) const {
+    return Arena.data() + Spans.at(I).first;
+  }
+  inline const rec *end(uint64_t I) const {
+    return Arena.data() + Spans.at(I).second;
+  }
+};
+
+void ReplayCorpus::add(const std::vector<rec> &Choices,
+                       const std::string &Name) {
+  auto B = Arena.size();
+  Arena.insert(Arena.end(), Choices.begin(), Choices.end());
+  Spans.push_back({B, Arena.size()});
+  Names.push_back(Name);
+}
+
+bool ReplayCorpus::addFile(const std::string &FileName,
+                           const std::string &Prefix) {
+  int Fd = open(FileName.c_str(), O_RDONLY);
+  if (Fd == -1) {
+    std::cerr << "FATAL ERROR: Cannot open choice file '" << FileName
+              << "'\n\n";
+    return false;
+  }
+  struct stat St;
+  void *Map = MAP_FAILED;
+  if (fstat(Fd, &St) == 0 && St.st_size > 0)
+    Map = mmap(nullptr, St.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+  close(Fd);
+  if (Map == MAP_FAILED) {
+    std::cerr << "FATAL ERROR: Cannot map choice file '" << FileName
+              << "'\n\n";
+    return false;
+  }
+  auto B = Arena.size();
+  bool Ok = FileGuide::parseChoices(static_cast<const char *>(Map),
+                                    St.st_size, Prefix, Arena);
+  munmap(Map, St.st_size);
+  if (!Ok) {
+    std::cerr << "FATAL ERROR: Cannot parse choice file '" << FileName
+              << "'\n\n";
+    Arena.resize(B);
+    return false;
+  }
+  Spans.push_back({B, Arena.size()});
+  Names.push_back(FileName);
+  return true;
+}
+
+void ReplayCorpus::addStore(CorpusStore &Store) {
+  Store.forEach([&](const PathHash &, const std::vector<rec> &Choices) {
+    add(Choices);
+  });
+}
+
+struct ReplayStats {
+  uint64_t Replayed = 0, Choices = 0;
+  // indices of the sequences whose replay diverged, in order
+  std::vector<uint64_t> Diverged;
+  double Seconds = 0;
+  inline double perSecond() const {
+    return Seconds > 0 ? Replayed / Seconds : 0;
+  }
+};
+
+inline std::ostream &operator<<(std::ostream &OS, const ReplayStats &S) {
+  return OS << S.Replayed << " replays (" << S.Choices << " choices) in "
+            << S.Seconds << " s, " << (uint64_t)S.perSecond()
+            << " per second, " << S.Diverged.size() << " diverged";
+}
+
+/*
+ * run Gen once for each sequence in the corpus, passing it a chooser
+ * that replays the sequence and the sequence's index. Gen is called
+ * concurrently from Threads threads (by default, one per core), so it
+ * must be thread-safe. a replay diverges if its FileChooser reports
+ * divergences, or if the generator finishes without using all of the
+ * saved values. scopes are handled according to S, which can't be
+ * Sync::BALANCE, since a reused chooser never gets to check the
+ * balance
+ */
+inline ReplayStats replay(const ReplayCorpus &Corpus,
+                          const std::function<void(Chooser &, uint64_t)> &Gen,
+                          unsigned Threads = 0, Sync S = Sync::NONE,
+                          uint64_t Seed = 0) {
+  if (S == Sync::BALANCE) {
+    std::cerr << "FATAL ERROR: Replay doesn't support Sync::BALANCE\n\n";
+    exit(-1);
+  }
+  if (Threads == 0)
+    Threads = std::max(1u, std::thread::hardware_concurrency());
+  std::atomic<uint64_t> Next(0);
+  std::vector<std::vector<uint64_t>> Diverged(Threads);
+  auto Start = std::chrono::steady_clock::now();
+
+  auto Worker = [&](unsigned T) {
+    FileGuide G(Seed + T);
+    G.setSync(S);
+    FileChooser C(G);
+    for (uint64_t I = Next++; I < Corpus.size(); I = Next++) {
+      C.reset(Corpus.begin(I), Corpus.end(I));
+      Gen(C, I);
+      if (C.divergences() > 0 || C.unconsumed() > 0)
+        Diverged.at(T).push_back(I);
+    }
+  };
+  std::vector<std::thread> Pool;
+  for (unsigned T = 1; T < Threads; ++T)
+    Pool.emplace_back(Worker, T);
+  Worker(0);
+  for (auto &Th : Pool)
+    Th.join();
+
+  ReplayStats Stats;
+  Stats.Seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - Start)
+                      .count();
+  Stats.Replayed = Corpus.size();
+  Stats.Choices = Corpus.totalChoices();
+  for (auto &D : Diverged)
+    Stats.Diverged.insert(Stats.Diverged.end(), D.begin(), D.end());
+  std::sort(Stats.Diverged.begin(), Stats.Diverged.end());
+  return Stats;
+}
+
+/*
+ * warm-start a guide from a corpus of saved choices. the saved values
+ * don't say how many choices there were at each step, so every
+ * sequence is replayed once, in parallel, and the path that the
+ * generator actually took is handed to the guide; ingestion itself is
+ * serialized. paths whose replay diverged are still real paths, so
+ * they get ingested too. paths recorded with their arities (by a
+ * TracingChooser) can go straight to Guide::ingest() instead
+ */
+inline ReplayStats ingest(Guide &G, const ReplayCorpus &Corpus,
+                          const std::function<void(Chooser &, uint64_t)> &Gen,
+                          unsigned Threads = 0, Sync S = Sync::NONE) {
+  std::mutex M;
+  return replay(
+      Corpus,
+      [&](Chooser &C, uint64_t I) {
+        TracingChooser T(C);
+        Gen(T, I);
+        std::lock_guard<std::mutex> Lock(M);
+        if (!G.ingest(T.steps())) {
+          std::cerr << "FATAL ERROR: Guide '" << G.name()
+                    << "' can't ingest paths\n\n";
+          exit(-1);
+        }
+      },
+      Threads, S);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace tree_guide
+
+#endif
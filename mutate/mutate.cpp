@@ -1,4 +1,9 @@
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
 #include "mutate.h"
+#include "path-index.h"
 
 using namespace tree_guide;
 
@@ -10,12 +15,22 @@ namespace mutator {
 
 static std::unique_ptr<std::mt19937_64> Rand;
 
+// the plugin's prefetch workers mutate while the plugin adds to the
+// fragment pool and the path index
+static std::mutex Lock;
+
+// half of the new values are boundary cases or values from the
+// corpus, instead of random ones
+static InterestingValues Values;
+
 void init(long Seed) { Rand = std::make_unique<std::mt19937_64>(Seed); }
 
+void add_values(const std::vector<rec> &C) {
+  std::lock_guard<std::mutex> L(Lock);
+  Values.harvest(C);
+}
+
 static void change_one(std::vector<rec> &C) {
-  std::uniform_int_distribution<uint64_t> FullDist(
-      std::numeric_limits<uint64_t>::min(),
-      std::numeric_limits<uint64_t>::max());
   std::uniform_int_distribution<uint64_t> LimitedDist(0, C.size() - 1);
   uint64_t x;
   // this could perform poorly if a choice sequence is almost entirely
@@ -24,15 +39,285 @@ static void change_one(std::vector<rec> &C) {
   do {
     x = LimitedDist(*Rand.get());
   } while (C.at(x).k != RecKind::NUM);
-  C.at(x).v = FullDist(*Rand.get());
+  C.at(x).v = Values.next(*Rand.get());
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * the fragment pool: balanced scopes, harvested from the corpus, that
+ * can be spliced in place of scopes in other sequences, which is the
+ * choice sequence version of swapping subtrees between test
+ * cases. scopes don't have labels, so a fragment is filed under its
+ * nesting depth and its site: the last value chosen in the enclosing
+ * scope before it started, which for a recursive generator is
+ * usually the decision that led to it. the pool holds each fragment
+ * once, and when it's full, new fragments replace random old ones
+ */
+
+struct Fragment {
+  std::vector<rec> Choices;
+  uint64_t Hash, Depth, Site;
+};
+
+// a scope in a sequence: [Begin, End] are the positions of its START
+// and END
+struct Span {
+  size_t Begin, End;
+  uint64_t Depth, Site;
+};
+
+// no value was chosen in the enclosing scope before this one started
+static const uint64_t NoSite = ~0ULL;
+
+static size_t MaxFragments = 10000;
+static std::vector<Fragment> Fragments;
+static std::unordered_set<uint64_t> FragmentHashes;
+// fragment indices by depth, and by depth and site
+static std::unordered_map<uint64_t, std::vector<size_t>> ByDepth, BySite;
+
+static uint64_t siteKey(uint64_t Depth, uint64_t Site) {
+  return mix64(Depth ^ mix64(Site));
+}
+
+static uint64_t hashOf(std::vector<rec>::const_iterator B,
+                       std::vector<rec>::const_iterator E) {
+  uint64_t H = 0;
+  for (auto It = B; It != E; ++It)
+    H = mix64(H ^ mix64((uint64_t)It->k ^ mix64(It->v)));
+  return H;
+}
+
+/*
+ * the scopes in a sequence, leaving out any outermost ones, which
+ * amount to the whole test case; if the scopes aren't balanced,
+ * there aren't any
+ */
+static std::vector<Span> scopes(const std::vector<rec> &C) {
+  std::vector<Span> Result;
+  // for each open scope: where it starts, and the last value chosen
+  // directly inside it
+  std::vector<std::pair<size_t, uint64_t>> Open;
+  for (size_t i = 0; i < C.size(); ++i) {
+    switch (C[i].k) {
+    case RecKind::START:
+      Open.push_back({i, NoSite});
+      break;
+    case RecKind::END:
+      if (Open.empty())
+        return {};
+      {
+        auto Begin = Open.back().first;
+        Open.pop_back();
+        if (!Open.empty())
+          Result.push_back({Begin, i, Open.size(), Open.back().second});
+      }
+      break;
+    case RecKind::NUM:
+      if (!Open.empty())
+        Open.back().second = C[i].v;
+      break;
+    default:
+      break;
+    }
+  }
+  if (!Open.empty())
+    return {};
+  return Result;
+}
+
+static void unindex(size_t I) {
+  auto &F = Fragments.at(I);
+  for (auto *Bucket :
+       {&ByDepth.at(F.Depth), &BySite.at(siteKey(F.Depth, F.Site))})
+    Bucket->erase(std::find(Bucket->begin(), Bucket->end(), I));
+  FragmentHashes.erase(F.Hash);
+}
+
+static void addFragment(Fragment F) {
+  if (MaxFragments == 0 || !FragmentHashes.insert(F.Hash).second)
+    return;
+  size_t I;
+  if (Fragments.size() < MaxFragments) {
+    I = Fragments.size();
+    Fragments.push_back(std::move(F));
+  } else {
+    std::uniform_int_distribution<size_t> Dist(0, Fragments.size() - 1);
+    I = Dist(*Rand.get());
+    unindex(I);
+    Fragments.at(I) = std::move(F);
+  }
+  auto &New = Fragments.at(I);
+  ByDepth[New.Depth].push_back(I);
+  BySite[siteKey(New.Depth, New.Site)].push_back(I);
+}
+
+void add_fragments(const std::vector<rec> &C) {
+  std::lock_guard<std::mutex> L(Lock);
+  for (auto &S : scopes(C)) {
+    auto B = C.begin() + S.Begin, E = C.begin() + S.End + 1;
+    addFragment({std::vector<rec>(B, E), hashOf(B, E), S.Depth, S.Site});
+  }
+}
+
+void set_max_fragments(size_t N) {
+  std::lock_guard<std::mutex> L(Lock);
+  MaxFragments = N;
+  while (Fragments.size() > MaxFragments) {
+    unindex(Fragments.size() - 1);
+    Fragments.pop_back();
+  }
+}
+
+size_t num_fragments() {
+  std::lock_guard<std::mutex> L(Lock);
+  return Fragments.size();
+}
+
+/*
+ * replace a random scope with a fragment from the pool, from the
+ * same site if there's one, or else from the same depth; returns
+ * false if there's nothing to splice
+ */
+static bool splice(std::vector<rec> &C) {
+  auto Spans = scopes(C);
+  if (Spans.empty() || Fragments.empty())
+    return false;
+  std::uniform_int_distribution<size_t> SpanDist(0, Spans.size() - 1);
+  // a few tries at finding a scope that something can go in
+  for (int Tries = 0; Tries < 8; ++Tries) {
+    auto &S = Spans.at(SpanDist(*Rand.get()));
+    const std::vector<size_t> *Bucket = nullptr;
+    auto It = BySite.find(siteKey(S.Depth, S.Site));
+    if (It != BySite.end() && !It->second.empty()) {
+      Bucket = &It->second;
+    } else {
+      auto It2 = ByDepth.find(S.Depth);
+      if (It2 != ByDepth.end() && !It2->second.empty())
+        Bucket = &It2->second;
+    }
+    if (!Bucket)
+      continue;
+    std::uniform_int_distribution<size_t> Dist(0, Bucket->size() - 1);
+    auto &F = Fragments.at(Bucket->at(Dist(*Rand.get()))).Choices;
+    C.erase(C.begin() + S.Begin, C.begin() + S.End + 1);
+    C.insert(C.begin() + S.Begin, F.begin(), F.end());
+    return true;
+  }
+  return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * tree-guided changes: we keep an index of the paths that the
+ * generator has taken, and use it to put effort where there's the
+ * most left to explore. a value gets changed with probability
+ * proportional to (S + 1) / (V + 1), where V is how many times its
+ * node has been visited and S is how many of the node's branches
+ * have been taken just once. that's the Good-Turing estimate of the
+ * chance of a new branch (like WeightedSamplerGuide's), smoothed so
+ * that rarely visited nodes count for a lot; values past the end of
+ * the known tree count as 1. the new value is the smallest one that
+ * hasn't been chosen at the node, if the values chosen so far leave a
+ * gap below it, since then it's surely a new branch; or else the
+ * least-taken other branch, or else an interesting value
+ */
+
+static PathIndex Tree;
+
+std::pair<uint64_t, bool> add_path(const std::vector<rec> &C) {
+  std::lock_guard<std::mutex> L(Lock);
+  return Tree.insert(C);
+}
+
+std::optional<uint64_t> find_path(const std::vector<rec> &C) {
+  std::lock_guard<std::mutex> L(Lock);
+  return Tree.find(C);
+}
+
+double path_novelty(const std::vector<rec> &C) {
+  std::lock_guard<std::mutex> L(Lock);
+  return Tree.meanNovelty(C);
+}
+
+static bool change_guided(std::vector<rec> &C) {
+  auto Walk = Tree.walk(C);
+  // the positions of the values in C, and their weights
+  std::vector<size_t> Positions;
+  std::vector<double> Weights;
+  for (size_t i = 0; i < C.size(); ++i) {
+    if (C[i].k != RecKind::NUM)
+      continue;
+    auto J = Positions.size();
+    Positions.push_back(i);
+    if (J < Walk.size()) {
+      auto &N = Tree.node(Walk[J]);
+      Weights.push_back((N.Singletons + 1.0) / (N.Visits + 1.0));
+    } else {
+      Weights.push_back(1.0);
+    }
+  }
+  if (Positions.empty())
+    return false;
+  std::discrete_distribution<size_t> Dist(Weights.begin(), Weights.end());
+  auto J = Dist(*Rand.get());
+  auto &V = C.at(Positions[J]).v;
+  if (J >= Walk.size()) {
+    V = Values.next(*Rand.get());
+    return true;
+  }
+  auto &Children = Tree.node(Walk[J]).Children;
+  std::uniform_int_distribution<int> Which(0, 2);
+  switch (Which(*Rand.get())) {
+  case 0: {
+    uint64_t X = 0;
+    while (Children.count(X))
+      ++X;
+    // with no gap, X may well be past the node's last branch
+    if (X < Children.size()) {
+      V = X;
+      return true;
+    }
+    [[fallthrough]];
+  }
+  case 1: {
+    uint64_t Best = V, BestVisits = std::numeric_limits<uint64_t>::max();
+    for (auto &[X, Child] : Children) {
+      auto Visits = Tree.node(Child).Visits;
+      if (X != V && Visits < BestVisits) {
+        Best = X;
+        BestVisits = Visits;
+      }
+    }
+    if (Best != V) {
+      V = Best;
+      return true;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+  V = Values.next(*Rand.get());
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+
 void mutate_choices(std::vector<rec> &C) {
+  std::lock_guard<std::mutex> L(Lock);
   std::uniform_int_distribution<uint64_t> CoinDist(0, 1);
+  // half of the time, splice in a fragment instead of changing values
+  if (CoinDist(*Rand.get()) == 0 && splice(C))
+    return;
   do {
-    change_one(C);
+    // once we know some paths, half of the changes are guided by them
+    bool Guided = Tree.paths() > 0 && CoinDist(*Rand.get()) == 0 &&
+                  change_guided(C);
+    if (!Guided)
+      change_one(C);
   } while (CoinDist(*Rand.get()) == 0);
 }
 
 } // end namespace mutator
-
@@ -5,4 +5,21 @@ namespace mutator {
 void init(long Seed);
 void mutate_choices(std::vector<tree_guide::rec> &C);
 
+// harvest the scopes in a sequence into the fragment pool that
+// mutate_choices() splices from
+void add_fragments(const std::vector<tree_guide::rec> &C);
+// bound the fragment pool (10000 by default)
+void set_max_fragments(size_t N);
+size_t num_fragments();
+// harvest the values in a sequence, which mutate_choices() will then
+// sometimes use in place of random ones
+void add_values(const std::vector<tree_guide::rec> &C);
+// the index of the paths that the generator took (the choices that
+// it saved), which also guides mutate_choices() towards unexplored
+// decisions; these are PathIndex's insert(), find() and
+// meanNovelty(), so that there's only one index, behind our lock
+std::pair<uint64_t, bool> add_path(const std::vector<tree_guide::rec> &C);
+std::optional<uint64_t> find_path(const std::vector<tree_guide::rec> &C);
+double path_novelty(const std::vector<tree_guide::rec> &C);
+
 };
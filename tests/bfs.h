@@ -0,0 +1,122 @@
+TEST_CASE("Best-first enumerates likely choices first") {
+  tree_guide::BestFirstGuide G;
+  std::vector<double> Weights = {0.1, 0.4, 0.2, 0.3};
+  std::vector<uint64_t> Order;
+  while (auto C = G.makeChooser())
+    Order.push_back(C->chooseWeighted(Weights));
+  REQUIRE(Order.size() == Weights.size());
+  REQUIRE(Order.front() == 1);
+  for (size_t i = 1; i < Order.size(); ++i)
+    REQUIRE(Weights.at(Order.at(i - 1)) >= Weights.at(Order.at(i)));
+}
+
+TEST_CASE("Best-first treats all-zero weights as uniform") {
+  tree_guide::BestFirstGuide G;
+  const std::vector<double> Zeros(3, 0.0), Below = {1, 2, 97, 0.5};
+  std::set<uint64_t> Seen;
+  std::vector<double> Probs;
+  while (auto C = G.makeChooser()) {
+    auto X = C->chooseWeighted(Zeros);
+    auto Y = C->chooseWeighted(Below);
+    Seen.insert(X * Below.size() + Y);
+    Probs.push_back(Below.at(Y));
+  }
+  REQUIRE(Seen.size() == Zeros.size() * Below.size());
+  // the paths below the uniform node still come out in order
+  for (size_t i = 1; i < Probs.size(); ++i)
+    REQUIRE(Probs.at(i - 1) >= Probs.at(i));
+}
+
+/*
+ * three levels of weighted choices, where at each level below the
+ * first one choice is much more likely than the others; returns the
+ * probability of the path taken
+ */
+static double weighted_levels(tree_guide::Chooser &C, int Level = 0) {
+  const std::vector<double> Top = {2, 5, 3}, Below = {1, 2, 97, 0.5};
+  auto &Weights = Level == 0 ? Top : Below;
+  double Total = 0;
+  for (auto W : Weights)
+    Total += W;
+  auto X = C.chooseWeighted(Weights);
+  double P = Weights.at(X) / Total;
+  if (Level == 2)
+    return P;
+  return P * weighted_levels(C, Level + 1);
+}
+
+TEST_CASE("Best-first enumerates a deeper tree by path probability") {
+  tree_guide::BestFirstGuide G;
+  std::vector<double> Probs;
+  while (auto C = G.makeChooser())
+    Probs.push_back(weighted_levels(*C));
+  REQUIRE(Probs.size() == 3 * 4 * 4);
+  for (size_t i = 1; i < Probs.size(); ++i)
+    REQUIRE(Probs.at(i - 1) >= Probs.at(i));
+}
+
+template <typename F> void check_batches(F Tree, uint64_t K) {
+  tree_guide::BFSGuide G;
+  std::vector<int> Results;
+  uint64_t NumLeaves = 0;
+  uint64_t Traversals = 0;
+  for (;;) {
+    auto Choosers = G.makeChoosers(K);
+    if (Choosers.empty())
+      break;
+    REQUIRE(Choosers.size() <= K);
+    // all of the choosers in the batch are live at once
+    for (auto &C : Choosers) {
+      auto Res = Tree(*C, NumLeaves);
+      if (Res >= Results.size())
+        Results.resize(Res + 1);
+      // no two traversals reach the same leaf
+      REQUIRE(Results.at(Res) == 0);
+      ++Results.at(Res);
+      ++Traversals;
+    }
+  }
+  REQUIRE(Traversals == NumLeaves);
+  REQUIRE(Results.size() == NumLeaves);
+}
+
+TEST_CASE("BFS enumerates standard trees in batches") {
+  for (uint64_t K : {1, 3, 16}) {
+    check_batches(test_maximally_unbalanced, K);
+    check_batches(test_full_tree, K);
+    check_batches(test_right_skewed_tree, K);
+    check_batches(test_path_with_thickets, K);
+    check_batches(test_increasing_degree_tree, K);
+    check_batches(test_decreasing_degree_tree, K);
+  }
+}
+
+template <typename F> void check_ingested(F Tree, uint64_t Paths) {
+  tree_guide::DefaultGuide DG(0);
+  tree_guide::BFSGuide G;
+  std::set<uint64_t> Seen;
+  uint64_t NumLeaves = 0;
+  for (uint64_t i = 0; i < Paths; ++i) {
+    auto C = DG.makeChooser();
+    tree_guide::TracingChooser T(*C);
+    Seen.insert(Tree(T, NumLeaves));
+    REQUIRE(G.ingest(T.steps()));
+  }
+  // the search only goes to leaves that weren't ingested
+  uint64_t Traversals = 0;
+  while (auto C = G.makeChooser()) {
+    REQUIRE(Seen.insert(Tree(*C, NumLeaves)).second);
+    ++Traversals;
+  }
+  REQUIRE(Seen.size() == NumLeaves);
+  REQUIRE(Traversals < NumLeaves);
+}
+
+TEST_CASE("BFS picks up where ingested paths left off") {
+  check_ingested(test_maximally_unbalanced, 20);
+  check_ingested(test_full_tree, 20);
+  check_ingested(test_right_skewed_tree, 20);
+  check_ingested(test_path_with_thickets, 20);
+  check_ingested(test_increasing_degree_tree, 20);
+  check_ingested(test_decreasing_degree_tree, 20);
+}
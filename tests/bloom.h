@@ -0,0 +1,44 @@
+TEST_CASE("Bloom guide stays within its memory budget") {
+  for (uint64_t Bytes : {64, 1000, 1 << 16, 1 << 20}) {
+    tree_guide::BloomGuide G(0, Bytes);
+    REQUIRE(G.memoryBytes() <= Bytes);
+    REQUIRE(G.memoryBytes() > Bytes / 4);
+    for (int i = 0; i < 1000; ++i) {
+      auto C = G.makeChooser();
+      REQUIRE(C);
+      test_full_tree_helper(*C, 12, 0, 2);
+    }
+    REQUIRE(G.memoryBytes() <= Bytes);
+  }
+}
+
+TEST_CASE("A tiny Bloom guide resets and carries on") {
+  const double MaxFPR = 0.01;
+  tree_guide::BloomGuide G(0, 256, MaxFPR);
+  std::set<uint64_t> Seen;
+  for (int i = 0; i < 2000; ++i) {
+    auto C = G.makeChooser();
+    REQUIRE(C);
+    Seen.insert(test_full_tree_helper(*C, 16, 0, 2));
+    C.reset();
+    REQUIRE(G.falsePositiveRate() <= MaxFPR);
+  }
+  REQUIRE(G.resets() > 0);
+  // forgetting everything makes for repeats, but traversals still
+  // spread across the tree
+  REQUIRE(Seen.size() > 1000);
+}
+
+TEST_CASE("Bloom guide handles nodes wider than its counters") {
+  // the per-prefix counters saturate at 255, so past that point a
+  // wide node is told apart only by the filter
+  tree_guide::BloomGuide G(0);
+  std::set<uint64_t> Seen;
+  for (int i = 0; i < 400; ++i) {
+    auto C = G.makeChooser();
+    REQUIRE(C);
+    Seen.insert(C->choose(1000));
+  }
+  REQUIRE(G.resets() == 0);
+  REQUIRE(Seen.size() > 300);
+}
@@ -0,0 +1,106 @@
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "guide-coro.h"
+#include "guide.h"
+
+/*
+ * coroutine versions of a couple of the standard trees, driven both
+ * synchronously through ordinary choosers and by the interleaving
+ * driver
+ */
+
+using namespace std;
+using namespace tree_guide;
+using namespace tree_guide::coro;
+
+Traversal<uint64_t> full_tree(int Depth, uint64_t Number) {
+  if (Depth == 0)
+    co_return Number;
+  auto Choice = co_await choose(2);
+  co_return co_await full_tree(Depth - 1, 2 * Number + Choice);
+}
+
+Traversal<uint64_t> maximally_unbalanced(int Depth, uint64_t Number,
+                                         uint64_t BranchFactor) {
+  if (Depth == 0)
+    co_return Number;
+  auto Choice = co_await choose(BranchFactor);
+  if (Choice != (BranchFactor - 1))
+    co_return Number + Choice;
+  co_return co_await maximally_unbalanced(
+      Depth - 1, Number + BranchFactor - 1, BranchFactor);
+}
+
+Traversal<string> scoped(int Depth) {
+  co_await beginScope();
+  string S;
+  const vector<double> Probs{0.5, 0.5};
+  if (Depth == 0 || co_await chooseWeighted(Probs)) {
+    S = to_string(co_await chooseUnimportant() % 10);
+  } else {
+    auto Inner = co_await scoped(Depth - 1);
+    S = "(" + Inner + ")";
+  }
+  co_await endScope();
+  co_return S;
+}
+
+void enumerate(const string &Name, function<Traversal<uint64_t>()> Make,
+               uint64_t NumLeaves) {
+  BFSGuide G(0);
+  vector<int> Seen(NumLeaves);
+  uint64_t Traversals = 0;
+  while (auto C = G.makeChooser()) {
+    auto Leaf = run(Make(), *C);
+    assert(Leaf < NumLeaves);
+    Seen.at(Leaf)++;
+    ++Traversals;
+  }
+  for (auto N : Seen)
+    assert(N == 1);
+  assert(Traversals == NumLeaves);
+  cout << Name << ": enumerated " << NumLeaves << " leaves\n";
+}
+
+int main() {
+  enumerate(
+      "full tree", [] { return full_tree(8, 0); }, 256);
+  enumerate(
+      "maximally unbalanced tree",
+      [] { return maximally_unbalanced(5, 0, 17); }, 81);
+
+  {
+    DefaultGuide G1(0);
+    SaverGuide G2(&G1, "");
+    auto C = G2.makeChooser();
+    auto S = run(scoped(5), *C);
+    auto Saved = static_cast<SaverChooser *>(C.get())->getChoices();
+    assert(Saved.front().k == RecKind::START);
+    assert(Saved.back().k == RecKind::END);
+    cout << "scoped: " << S << "\n";
+  }
+
+  {
+    // every traversal makes exactly 10 choices and a finished slot
+    // immediately starts its replacement, so the rounds line up
+    const int Depth = 10, Width = 1000, Count = 5000;
+    DefaultGuide G(0);
+    Interleaver<uint64_t> I(
+        G, [] { return full_tree(Depth, 0); }, Width);
+    vector<int> Seen(1 << Depth);
+    auto Completed = I.run(Count, [&](uint64_t &Leaf) { Seen.at(Leaf)++; });
+    assert(Completed == Count);
+    assert(I.rounds() == (Count / Width) * Depth + 1);
+    int Distinct = 0;
+    for (auto N : Seen)
+      Distinct += N > 0;
+    cout << "interleaved " << Completed << " traversals in " << I.rounds()
+         << " rounds, " << Distinct << " distinct leaves\n";
+  }
+
+  cout << "coroutine test passed\n";
+  return 0;
+}
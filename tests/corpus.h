@@ -0,0 +1,89 @@
+static std::vector<tree_guide::rec> recs(std::vector<uint64_t> Values) {
+  std::vector<tree_guide::rec> Recs;
+  for (auto V : Values)
+    Recs.push_back({tree_guide::RecKind::NUM, V});
+  return Recs;
+}
+
+TEST_CASE("Corpus entries share prefixes") {
+  tree_guide::CorpusGuide G(0);
+  G.addEntry(recs({1, 2, 3, 4}));
+  G.addEntry(recs({1, 2, 3, 5}));
+  G.addEntry(recs({1, 2, 6}));
+  G.addEntry(recs({1, 2}));
+  REQUIRE(G.entries() == 4);
+  // [1, 2] [3] [4] [5] [6]
+  REQUIRE(G.storedValues() == 6);
+  REQUIRE(G.trieNodes() == 6);
+
+  std::stringstream File("// BEGIN FORMATTED CHOICES\n"
+                         "// 7,{,8,},\n"
+                         "// END FORMATTED CHOICES\n");
+  REQUIRE(G.addEntry(File, "// "));
+  REQUIRE(G.entries() == 5);
+  REQUIRE(G.storedValues() == 8);
+}
+
+TEST_CASE("Corpus guide favors high-scoring entries") {
+  // two leaves of the full tree, as choice sequences
+  tree_guide::CorpusGuide G(0);
+  G.addEntry(recs({1, 1, 1, 1, 1, 1}), 10.0);
+  G.addEntry(recs({0, 0, 0, 0, 0, 0}), 1.0);
+  std::vector<int> Counts(64);
+  uint64_t NumLeaves;
+  for (int i = 0; i < 2000; ++i) {
+    auto C = G.makeChooser();
+    Counts.at(test_full_tree(*C, NumLeaves))++;
+  }
+  // entries are replayed in full often enough to stand out from the
+  // random continuations
+  REQUIRE(Counts.at(63) > 10 * Counts.at(1));
+  REQUIRE(Counts.at(0) > Counts.at(1));
+  REQUIRE(Counts.at(63) > Counts.at(0));
+}
+
+TEST_CASE("Corpus guide continues with the inner guide") {
+  tree_guide::BFSGuide Inner(0);
+  tree_guide::CorpusGuide G(0, &Inner);
+  uint64_t NumLeaves;
+  // with an empty corpus, the inner guide does everything
+  std::set<uint64_t> Leaves;
+  for (int i = 0; i < 64; ++i) {
+    auto C = G.makeChooser();
+    Leaves.insert(test_full_tree(*C, NumLeaves));
+  }
+  REQUIRE(Leaves.size() == 64);
+}
+
+TEST_CASE("Corpus guide steers a stateful inner guide from the root") {
+  uint64_t NumLeaves;
+  SECTION("BFS") {
+    tree_guide::BFSGuide Inner(0);
+    tree_guide::CorpusGuide G(0, &Inner);
+    G.addEntry(recs({1, 1, 1, 1, 1, 1}));
+    G.addEntry(recs({0, 1, 0, 1, 0, 1}));
+    std::set<uint64_t> Leaves;
+    for (int i = 0; i < 1000; ++i) {
+      auto C = G.makeChooser();
+      Leaves.insert(test_full_tree(*C, NumLeaves));
+    }
+    REQUIRE(Leaves.size() == 64);
+  }
+
+  SECTION("weighted sampler") {
+    tree_guide::WeightedSamplerGuide Inner(0);
+    tree_guide::CorpusGuide G(0, &Inner);
+    G.addEntry(recs({1, 1, 1, 1, 1, 1}));
+    G.addEntry(recs({0, 1, 0, 1, 0, 1}));
+    int Traversals = 0;
+    while (!Inner.isExhausted()) {
+      auto C = G.makeChooser();
+      test_full_tree(*C, NumLeaves);
+      REQUIRE(++Traversals < 1000);
+    }
+    // the sampler saw every traversal, replayed prefixes included
+    auto C = Inner.makeChooser();
+    test_full_tree(*C, NumLeaves);
+    REQUIRE(Inner.sizeEstimate() == 64.0);
+  }
+}
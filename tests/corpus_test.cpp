@@ -0,0 +1,143 @@
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "corpus-store.h"
+#include "gen_regex.h"
+
+/*
+ * store a pile of regex generator choice sequences in a CorpusStore,
+ * then check that they come back unchanged, that duplicates are
+ * dropped, and that the store survives being reopened and having
+ * junk left at the end of its files
+ */
+
+const long N = 2000;
+const long MaxDepth = 10;
+const std::string Name("corpus_test_store");
+
+using namespace std;
+using namespace tree_guide;
+
+bool same(const vector<rec> &A, const vector<rec> &B) {
+  if (A.size() != B.size())
+    return false;
+  for (size_t i = 0; i < A.size(); ++i)
+    if (A.at(i).k != B.at(i).k || A.at(i).v != B.at(i).v)
+      return false;
+  return true;
+}
+
+void cleanup() {
+  remove((Name + ".pack").c_str());
+  remove((Name + ".idx").c_str());
+}
+
+int main() {
+  cleanup();
+  vector<vector<rec>> Seqs;
+  uint64_t TextBytes = 0;
+  {
+    DefaultGuide G1(0);
+    SaverGuide G2(&G1, "");
+    for (long i = 0; i < N; ++i) {
+      auto C = G2.makeChooser();
+      auto S = static_cast<SaverChooser *>(C.get());
+      gen(*S, 1 + (i % MaxDepth));
+      Seqs.push_back(S->getChoices());
+      TextBytes += S->formatChoices().size();
+    }
+  }
+
+  uint64_t Distinct = 0;
+  {
+    CorpusStore Store(Name);
+    for (auto &S : Seqs)
+      Distinct += Store.append(S);
+    assert(Store.size() == Distinct);
+    // everything is already there
+    for (auto &S : Seqs)
+      assert(!Store.append(S));
+    assert(Store.size() == Distinct);
+    cout << Distinct << " distinct sequences in " << Store.packBytes()
+         << " bytes, versus " << TextBytes << " bytes of text\n";
+    assert(Store.packBytes() < TextBytes / 3);
+  }
+
+  {
+    CorpusStore Store(Name);
+    assert(Store.size() == Distinct);
+    for (auto &S : Seqs) {
+      auto Found = Store.lookup(CorpusStore::hashOf(S));
+      assert(Found);
+      assert(same(*Found, S));
+    }
+    vector<rec> Missing{{RecKind::NUM, 12345}};
+    assert(!Store.contains(CorpusStore::hashOf(Missing)));
+    assert(!Store.lookup(CorpusStore::hashOf(Missing)));
+    uint64_t Visited = 0;
+    Store.forEach([&](const PathHash &H, const vector<rec> &S) {
+      assert(H == CorpusStore::hashOf(S));
+      ++Visited;
+    });
+    assert(Visited == Distinct);
+  }
+
+  {
+    // an interrupted append leaves a record without an index entry
+    // and possibly part of an index entry; both get dropped
+    ofstream Pack(Name + ".pack", ios::app | ios::binary);
+    Pack << "junk junk junk";
+    Pack.close();
+    ofstream Idx(Name + ".idx", ios::app | ios::binary);
+    Idx << "junk";
+    Idx.close();
+    CorpusStore Store(Name);
+    assert(Store.size() == Distinct);
+    vector<rec> Extra{{RecKind::START, 0}, {RecKind::NUM, ~0ULL},
+                      {RecKind::NUM, 7}, {RecKind::END, 0}};
+    assert(Store.append(Extra));
+    auto Found = Store.lookup(CorpusStore::hashOf(Extra));
+    assert(Found && same(*Found, Extra));
+    auto First = Store.lookup(CorpusStore::hashOf(Seqs.front()));
+    assert(First && same(*First, Seqs.front()));
+  }
+
+  {
+    CorpusStore Store(Name);
+    assert(Store.size() == Distinct + 1);
+  }
+  cleanup();
+
+  {
+    // sequences that differ only near the end should cost little more
+    // than their differences, no matter how long they are
+    CorpusStore Store(Name, 4);
+    vector<rec> Long;
+    for (uint64_t i = 0; i < 1000; ++i)
+      Long.push_back({RecKind::NUM, i % 100});
+    Store.append(Long);
+    auto Full = Store.packBytes();
+    for (uint64_t i = 0; i < 100; ++i) {
+      auto Variant = Long;
+      Variant.at(995) = {RecKind::NUM, 1000 + i};
+      assert(Store.append(Variant));
+    }
+    cout << "100 variants of a " << Full << " byte record take "
+         << Store.packBytes() - Full << " bytes\n";
+    assert(Store.packBytes() - Full < 100 * 16);
+    for (uint64_t i = 0; i < 100; ++i) {
+      auto Variant = Long;
+      Variant.at(995) = {RecKind::NUM, 1000 + i};
+      auto Found = Store.lookup(CorpusStore::hashOf(Variant));
+      assert(Found && same(*Found, Variant));
+    }
+  }
+
+  cleanup();
+  cout << "corpus test passed\n";
+  return 0;
+}
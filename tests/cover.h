@@ -0,0 +1,51 @@
+static std::vector<tree_guide::rec> choices(std::string Str) {
+  std::vector<tree_guide::rec> Recs;
+  for (auto c : Str) {
+    if (c == '{')
+      Recs.push_back({tree_guide::RecKind::START, 0});
+    else if (c == '}')
+      Recs.push_back({tree_guide::RecKind::END, 0});
+    else
+      Recs.push_back({tree_guide::RecKind::NUM, (uint64_t)(c - '0')});
+  }
+  return Recs;
+}
+
+TEST_CASE("Context edges only look a few values back") {
+  using tree_guide::contextEdges;
+  // repeats are one edge
+  REQUIRE(contextEdges(choices("1"), 2).size() == 1);
+  REQUIRE(contextEdges(choices("11"), 0).size() == 1);
+  REQUIRE(contextEdges(choices("11"), 1).size() == 2);
+  // sequences that differ only further back than K values end up at
+  // the same node, so they share their later edges
+  auto A = contextEdges(choices("1234"), 2);
+  auto B = contextEdges(choices("5234"), 2);
+  std::vector<uint64_t> Shared;
+  std::set_intersection(A.begin(), A.end(), B.begin(), B.end(),
+                        std::back_inserter(Shared));
+  REQUIRE(Shared.size() == 1);
+  // but scopes count as context
+  REQUIRE(contextEdges(choices("12"), 2) != contextEdges(choices("1{2}"), 2));
+  // and the empty path is a path
+  REQUIRE(contextEdges(choices(""), 4).size() == 1);
+  REQUIRE(contextEdges(choices("{}"), 4) == contextEdges(choices(""), 4));
+  REQUIRE(contextEdges(choices(""), 4) != contextEdges(choices("0"), 4));
+}
+
+TEST_CASE("Greedy cover keeps the coverage with fewer, smaller items") {
+  std::vector<std::vector<uint64_t>> Edges = {
+      {1, 2}, {1, 2, 3}, {4}, {3, 4}, {1, 2, 3}, {}, {5}};
+  std::vector<uint64_t> Sizes = {1, 10, 1, 5, 2, 1, 100};
+  uint64_t Covered;
+  auto Chosen = tree_guide::greedyCover(Edges, Sizes, Covered);
+  REQUIRE(Covered == 5);
+  // the biggest item first, the smaller of two that are the same, and
+  // nothing that only covers what's already covered
+  REQUIRE(Chosen == std::vector<size_t>{4, 2, 6});
+
+  // in the other order, a tie goes to the earlier item
+  Sizes = {1, 2, 1, 5, 2, 1, 100};
+  Chosen = tree_guide::greedyCover(Edges, Sizes, Covered);
+  REQUIRE(Chosen == std::vector<size_t>{1, 2, 6});
+}
@@ -0,0 +1,102 @@
+TEST_CASE("Path hashes identify paths") {
+  std::vector<tree_guide::rec> Choices;
+  for (uint64_t X : {1, 0, 1, 1, 0, 1})
+    Choices.push_back({tree_guide::RecKind::NUM, X});
+  tree_guide::FileGuide G;
+  G.replaceChoices(Choices);
+  uint64_t NumLeaves;
+  auto C1 = G.makeChooser();
+  auto C2 = G.makeChooser();
+  REQUIRE(C1->pathHash() == C2->pathHash());
+  auto Leaf = test_full_tree(*C1, NumLeaves);
+  REQUIRE(C1->pathHash() != C2->pathHash());
+  REQUIRE(test_full_tree(*C2, NumLeaves) == Leaf);
+  REQUIRE(C1->pathHash() == C2->pathHash());
+
+  // a different path through the same tree
+  Choices.back().v = 0;
+  G.replaceChoices(Choices);
+  auto C3 = G.makeChooser();
+  test_full_tree(*C3, NumLeaves);
+  REQUIRE(C3->pathHash() != C1->pathHash());
+
+  // wrappers report the hash of the chooser they wrap
+  tree_guide::DefaultGuide G1(0);
+  tree_guide::SaverGuide G2(&G1, "");
+  auto C4 = G2.makeChooser();
+  test_full_tree(*C4, NumLeaves);
+  auto Saved = static_cast<tree_guide::SaverChooser *>(C4.get());
+  G.replaceChoices(Saved->getChoices());
+  auto C5 = G.makeChooser();
+  test_full_tree(*C5, NumLeaves);
+  REQUIRE(C4->pathHash() == C5->pathHash());
+}
+
+TEST_CASE("Cuckoo filter has no false negatives") {
+  const uint64_t N = 10000;
+  tree_guide::CuckooFilter F(N);
+  std::mt19937_64 R(0);
+  std::vector<tree_guide::PathHash> Hashes;
+  for (uint64_t i = 0; i < N; ++i) {
+    tree_guide::PathHash H{R(), R()};
+    Hashes.push_back(H);
+    F.insert(H);
+  }
+  REQUIRE(F.dropped() == 0);
+  for (auto &H : Hashes)
+    REQUIRE(F.contains(H));
+  uint64_t FalsePositives = 0;
+  for (uint64_t i = 0; i < 10 * N; ++i)
+    FalsePositives += F.contains({R(), R()});
+  REQUIRE(FalsePositives < N / 100);
+}
+
+TEST_CASE("DedupGuide retries duplicate traversals") {
+  tree_guide::DefaultGuide G1(0);
+  tree_guide::DedupGuide G2(&G1);
+  std::function<uint64_t(tree_guide::Chooser &)> Gen =
+      [](tree_guide::Chooser &C) {
+        uint64_t NumLeaves;
+        return test_full_tree(C, NumLeaves);
+      };
+  std::set<uint64_t> Leaves;
+  for (int i = 0; i < 64; ++i) {
+    auto Leaf = G2.generateUnique(Gen, 100000);
+    REQUIRE(Leaf.has_value());
+    REQUIRE(Leaves.insert(*Leaf).second);
+  }
+  REQUIRE(G2.duplicates() > 0);
+  // there's nothing new left
+  REQUIRE(!G2.generateUnique(Gen, 100).has_value());
+}
+
+TEST_CASE("DedupGuide passes ingested and steered paths through") {
+  tree_guide::DefaultGuide DG(0);
+  tree_guide::BFSGuide G1;
+  tree_guide::DedupGuide G2(&G1);
+  std::set<uint64_t> Seen;
+  uint64_t NumLeaves;
+  for (int i = 0; i < 10; ++i) {
+    auto C = DG.makeChooser();
+    tree_guide::TracingChooser T(*C);
+    Seen.insert(test_full_tree(T, NumLeaves));
+    REQUIRE(G2.ingest(T.steps()));
+  }
+  // a steered traversal down an ingested path is a duplicate
+  auto First = Seen.begin();
+  {
+    uint64_t Depth = 0;
+    auto C = G2.makeSteeredChooser([&](uint64_t, uint64_t &Choice) {
+      Choice = (*First >> (5 - Depth++)) & 1;
+      return true;
+    });
+    REQUIRE(C);
+    REQUIRE(test_full_tree(*C, NumLeaves) == *First);
+  }
+  REQUIRE(G2.duplicates() == 1);
+  // the wrapped guide only goes to leaves that weren't ingested
+  while (auto C = G2.makeChooser())
+    REQUIRE(Seen.insert(test_full_tree(*C, NumLeaves)).second);
+  REQUIRE(Seen.size() == NumLeaves);
+  REQUIRE(G2.duplicates() == 1);
+}
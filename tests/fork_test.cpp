@@ -0,0 +1,112 @@
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+
+#include "fork-runner.h"
+#include "guide.h"
+#include "standard-trees.h"
+
+/*
+ * check that ForkRunner visits every leaf of a tree exactly once while
+ * running each prefix only once; the generators run in child
+ * processes, so they report back through shared memory
+ */
+
+using namespace std;
+using namespace tree_guide;
+
+struct Shared {
+  uint64_t PrefixRuns;
+  uint64_t Escapes;
+  uint64_t Seen[1024];
+};
+
+Shared *S;
+
+void check(const string &Name, function<uint64_t(Chooser &)> Tree,
+           uint64_t NumLeaves, uint64_t ForkDepth, uint64_t NumPrefixes,
+           function<unique_ptr<Guide>()> MakeSuffixGuide) {
+  memset(S, 0, sizeof(*S));
+  BFSGuide PrefixG(0);
+  ForkRunner R(PrefixG, MakeSuffixGuide, ForkDepth);
+  while (R.run([&](Chooser &C) {
+    __atomic_add_fetch(&S->PrefixRuns, 1, __ATOMIC_SEQ_CST);
+    auto Leaf = Tree(C);
+    assert(Leaf < NumLeaves);
+    __atomic_add_fetch(&S->Seen[Leaf], 1, __ATOMIC_SEQ_CST);
+  }))
+    ;
+  cout << Name << ": " << R.prefixes() << " prefixes, " << R.leaves()
+       << " leaves\n";
+  assert(R.crashes() == 0);
+  assert(R.leaves() == NumLeaves);
+  assert(R.prefixes() == NumPrefixes);
+  assert(S->PrefixRuns == NumPrefixes);
+  for (uint64_t i = 0; i < NumLeaves; ++i)
+    assert(S->Seen[i] == 1);
+}
+
+/*
+ * a generator that throws in a suffix is a crash like any other: the
+ * child must exit rather than return from run() as a copy of us
+ */
+void checkThrow() {
+  memset(S, 0, sizeof(*S));
+  BFSGuide PrefixG(0);
+  ForkRunner R(
+      PrefixG, []() -> unique_ptr<Guide> { return make_unique<BFSGuide>(1); },
+      4);
+  // only children run the generator, so only they can get here
+  try {
+    while (R.run([&](Chooser &C) {
+      if (test_full_tree_helper(C, 10, 0, 2) == 5)
+        throw runtime_error("leaf 5");
+    }))
+      ;
+  } catch (const runtime_error &) {
+    __atomic_add_fetch(&S->Escapes, 1, __ATOMIC_SEQ_CST);
+    _exit(0);
+  }
+  cout << "throwing generator: " << R.crashes() << " crashes\n";
+  assert(S->Escapes == 0);
+  assert(R.crashes() == 1);
+}
+
+int main() {
+  void *Mem = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  assert(Mem != MAP_FAILED);
+  S = static_cast<Shared *>(Mem);
+
+  auto BFS = []() -> unique_ptr<Guide> { return make_unique<BFSGuide>(1); };
+  auto WS = []() -> unique_ptr<Guide> {
+    auto G = make_unique<WeightedSamplerGuide>(1);
+    G->setStopWhenExhausted(true);
+    return G;
+  };
+
+  for (auto &[GuideName, Make] :
+       vector<pair<string, function<unique_ptr<Guide>()>>>{{"BFS", BFS},
+                                                           {"WS", WS}}) {
+    check(
+        "full tree, " + GuideName + " suffixes",
+        [](Chooser &C) { return test_full_tree_helper(C, 10, 0, 2); }, 1024, 4,
+        16, Make);
+    // some leaves are above the fork depth
+    check(
+        "maximally unbalanced tree, " + GuideName + " suffixes",
+        [](Chooser &C) {
+          return test_maximally_unbalanced_helper(C, 5, 0, 17);
+        },
+        81, 2, 17 + 16, Make);
+  }
+
+  checkThrow();
+
+  cout << "fork test passed\n";
+  return 0;
+}
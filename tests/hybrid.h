@@ -0,0 +1,70 @@
+TEST_CASE("Hybrid guide deepens its boundary and finishes small trees") {
+  tree_guide::HybridGuide G(0);
+  std::vector<int> Results;
+  int Traversals = 0;
+  while (auto C = G.makeChooser()) {
+    uint64_t NumLeaves;
+    auto Res = test_full_tree(*C, NumLeaves);
+    if (Res >= Results.size())
+      Results.resize(Res + 1);
+    ++Results.at(Res);
+    ++Traversals;
+    REQUIRE(Traversals < 10000);
+  }
+  REQUIRE(Results.size() == 64);
+  for (auto R : Results)
+    REQUIRE(R > 0);
+  REQUIRE(G.boundary() >= 6);
+}
+
+TEST_CASE("Hybrid guide respects its node budget") {
+  tree_guide::HybridGuide G(0, 20);
+  for (int i = 0; i < 1000; ++i) {
+    auto C = G.makeChooser();
+    REQUIRE(C);
+    uint64_t NumLeaves;
+    test_increasing_degree_tree(*C, NumLeaves);
+  }
+  REQUIRE(G.totalNodes() <= 20);
+}
+
+TEST_CASE("Hybrid guide can start from a weighted sampler's tree") {
+  SECTION("an exhausted tree still moves the boundary down") {
+    tree_guide::WeightedSamplerGuide WS(0);
+    uint64_t NumLeaves;
+    while (!WS.isExhausted()) {
+      auto C = WS.makeChooser();
+      test_full_tree(*C, NumLeaves);
+    }
+    tree_guide::HybridGuide G(0);
+    G.transferFrom(WS);
+    // just as for a guide that built the same tree itself, exhausted
+    // samplers don't end the search; enumerating exactly does
+    std::set<uint64_t> Seen;
+    int Traversals = 0;
+    while (auto C = G.makeChooser()) {
+      Seen.insert(test_full_tree(*C, NumLeaves));
+      REQUIRE(++Traversals < 10000);
+    }
+    REQUIRE(Seen.size() == NumLeaves);
+    REQUIRE(G.boundary() >= 6);
+  }
+
+  SECTION("a partial tree gets finished") {
+    tree_guide::WeightedSamplerGuide WS(0);
+    uint64_t NumLeaves;
+    for (int i = 0; i < 20; ++i) {
+      auto C = WS.makeChooser();
+      test_full_tree(*C, NumLeaves);
+    }
+    tree_guide::HybridGuide G(0);
+    G.transferFrom(WS);
+    std::set<uint64_t> Seen;
+    int Traversals = 0;
+    while (auto C = G.makeChooser()) {
+      Seen.insert(test_full_tree(*C, NumLeaves));
+      REQUIRE(++Traversals < 10000);
+    }
+    REQUIRE(Seen.size() == NumLeaves);
+  }
+}
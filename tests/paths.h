@@ -0,0 +1,78 @@
+TEST_CASE("Path index tells known paths from new ones") {
+  tree_guide::PathIndex Index;
+  tree_guide::DefaultGuide G1(0);
+  tree_guide::SaverGuide G2(&G1, "");
+  std::set<uint64_t> Leaves;
+  std::vector<std::vector<tree_guide::rec>> Paths;
+  uint64_t NumLeaves;
+  for (int i = 0; i < 200; ++i) {
+    auto C = G2.makeChooser();
+    auto Leaf = test_right_skewed_tree(*C, NumLeaves);
+    auto &Saved = static_cast<tree_guide::SaverChooser *>(C.get())->getChoices();
+    // a path is new exactly when its leaf is
+    REQUIRE(Index.insert(Saved).second == Leaves.insert(Leaf).second);
+    Paths.push_back(Saved);
+  }
+  REQUIRE(Index.paths() == Leaves.size());
+  for (auto &P : Paths) {
+    auto Id = Index.find(P);
+    REQUIRE(Id);
+    auto [Again, New] = Index.insert(P);
+    REQUIRE(!New);
+    REQUIRE(Again == *Id);
+  }
+  // a proper prefix of a path isn't a path
+  auto Prefix = Paths.front();
+  Prefix.pop_back();
+  REQUIRE(!Index.find(Prefix));
+  // scopes don't matter
+  auto Scoped = Paths.front();
+  Scoped.insert(Scoped.begin(), {tree_guide::RecKind::START, 0});
+  Scoped.push_back({tree_guide::RecKind::END, 0});
+  REQUIRE(Index.find(Scoped) == Index.find(Paths.front()));
+}
+
+TEST_CASE("Path index estimates novelty") {
+  tree_guide::PathIndex Index;
+  std::vector<tree_guide::rec> P;
+  for (uint64_t X : {0, 0, 0})
+    P.push_back({tree_guide::RecKind::NUM, X});
+  // nothing known yet
+  for (auto N : Index.novelty(P))
+    REQUIRE(N == 1.0);
+  Index.insert(P);
+  Index.insert(P);
+  // the only path has been seen twice, so no singletons anywhere
+  for (auto N : Index.novelty(P))
+    REQUIRE(N == 0.0);
+  auto Q = P;
+  Q.at(1).v = 1;
+  Index.insert(Q);
+  auto Novelty = Index.novelty(Q);
+  REQUIRE(Novelty.at(0) == 0.0);
+  REQUIRE(Novelty.at(1) == Catch::Approx(1.0 / 3.0));
+  REQUIRE(Novelty.at(2) == 1.0);
+  REQUIRE(Index.meanNovelty(Q) == Catch::Approx(4.0 / 9.0));
+  REQUIRE(Index.meanNovelty({}) == 0.0);
+}
+
+TEST_CASE("Path index walks a sequence's nodes") {
+  tree_guide::PathIndex Index;
+  std::vector<tree_guide::rec> P;
+  for (uint64_t X : {0, 1, 2})
+    P.push_back({tree_guide::RecKind::NUM, X});
+  REQUIRE(Index.walk(P) == std::vector<uint64_t>{0});
+  Index.insert(P);
+  auto Walk = Index.walk(P);
+  REQUIRE(Walk.size() == 3);
+  REQUIRE(Walk.at(0) == 0);
+  for (size_t i = 0; i < 3; ++i) {
+    auto &N = Index.node(Walk.at(i));
+    REQUIRE(N.Visits == 1);
+    REQUIRE(N.Children.count(P.at(i).v));
+  }
+  // a different choice leaves the index right after its node
+  auto Q = P;
+  Q.at(1).v = 5;
+  REQUIRE(Index.walk(Q) == std::vector<uint64_t>{Walk.at(0), Walk.at(1)});
+}
@@ -0,0 +1,142 @@
+#include <cassert>
+#include <cmath>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "guide.h"
+#include "standard-trees.h"
+
+/*
+ * compare WeightedSamplerGuide explore/exploit policies. small trees
+ * get enumerated exactly no matter what the policy is, since exhausted
+ * subtrees are pruned, so here we use scaled-up versions of the
+ * standard trees that have many more leaves than we take samples. leaf
+ * numbers are dense, so under uniform sampling each of BUCKETS equal
+ * ranges of leaf numbers should get the same share of the samples; we
+ * report the total variation distance from that ideal (lower is
+ * better) along with the CPU time per sample. we also report how many
+ * samples it took for the distance to get below THRESHOLD and stay
+ * there, checking every CHECK samples, averaged over the seeds; a
+ * dash means that some seed never got there. truly uniform sampling
+ * gets there after about 270 samples on average
+ */
+
+const int SEEDS = 3;
+const int SAMPLES = 1000;
+const int BUCKETS = 16;
+const int CHECK = 10;
+const double THRESHOLD = 0.1;
+
+using namespace std;
+using namespace tree_guide;
+
+typedef function<unique_ptr<ExplorePolicy>()> PolicyMaker;
+typedef function<uint64_t(Chooser &)> Tree;
+
+// total variation distance between the bucket counts and uniform
+double distance(const vector<double> &Counts, int Samples) {
+  double Distance = 0;
+  for (auto N : Counts)
+    Distance += fabs(N / Samples - 1.0 / BUCKETS);
+  return Distance / 2;
+}
+
+void bench(const string &TreeName, Tree T, uint64_t NumLeaves,
+           const string &PolicyName, PolicyMaker Make) {
+  double TotalDistance = 0, TotalSeconds = 0;
+  int TotalConverged = 0;
+  bool AllConverged = true;
+  for (int Seed = 0; Seed < SEEDS; ++Seed) {
+    WeightedSamplerGuide G(Seed);
+    G.setExplorePolicy(Make());
+    vector<double> Counts(BUCKETS);
+    int LastAbove = 0;
+    double Seconds = 0;
+    auto Start = clock();
+    for (int i = 1; i <= SAMPLES; ++i) {
+      auto C = G.makeChooser();
+      auto Leaf = T(*C);
+      assert(Leaf < NumLeaves);
+      Counts.at(Leaf * BUCKETS / NumLeaves) += 1;
+      if (i % CHECK == 0) {
+        Seconds += (double)(clock() - Start) / CLOCKS_PER_SEC;
+        if (distance(Counts, i) >= THRESHOLD)
+          LastAbove = i;
+        Start = clock();
+      }
+    }
+    Seconds += (double)(clock() - Start) / CLOCKS_PER_SEC;
+    TotalSeconds += Seconds;
+    TotalDistance += distance(Counts, SAMPLES);
+    if (LastAbove + CHECK > SAMPLES)
+      AllConverged = false;
+    else
+      TotalConverged += LastAbove + CHECK;
+  }
+  cout << setw(24) << left << TreeName << setw(12) << PolicyName << setw(10)
+       << right << fixed << setprecision(3) << TotalDistance / SEEDS
+       << setw(12) << setprecision(2)
+       << 1e6 * TotalSeconds / (SEEDS * SAMPLES) << setw(12);
+  if (AllConverged)
+    cout << TotalConverged / SEEDS << "\n";
+  else
+    cout << "-\n";
+}
+
+int main() {
+  const uint64_t UnbalancedDepth = 200, UnbalancedDegree = 17;
+  const uint64_t FullDepth = 16;
+  const uint64_t SkewedDepth = 300;
+  const uint64_t ThicketSize = 100000, BushSize = 64;
+  const uint64_t DegreeDepth = 9;
+  uint64_t Factorial = 1;
+  for (uint64_t i = 1; i <= DegreeDepth; ++i)
+    Factorial *= i;
+  vector<tuple<string, Tree, uint64_t>> Trees = {
+      {"maximally_unbalanced",
+       [&](Chooser &C) {
+         return test_maximally_unbalanced_helper(C, UnbalancedDepth, 0,
+                                                 UnbalancedDegree);
+       },
+       (UnbalancedDegree - 1) * (UnbalancedDepth - 1) + UnbalancedDegree},
+      {"full_tree",
+       [&](Chooser &C) { return test_full_tree_helper(C, FullDepth, 0, 2); },
+       ipow(2, FullDepth)},
+      {"right_skewed_tree",
+       [&](Chooser &C) {
+         return test_right_skewed_tree_helper(C, SkewedDepth, 0);
+       },
+       SkewedDepth * (SkewedDepth + 1) / 2 + 1},
+      {"path_with_thickets",
+       [&](Chooser &C) {
+         return test_path_with_thickets_helper(C, ThicketSize, 0, BushSize,
+                                               true);
+       },
+       ThicketSize},
+      {"increasing_degree_tree",
+       [&](Chooser &C) {
+         return test_increasing_degree_tree_helper(C, DegreeDepth, 0, 1);
+       },
+       Factorial},
+  };
+  vector<pair<string, PolicyMaker>> Policies = {
+      {"threshold", [] { return make_unique<ThresholdPolicy>(); }},
+      {"UCB", [] { return make_unique<UCBPolicy>(); }},
+      {"Thompson", [] { return make_unique<ThompsonPolicy>(); }},
+      {"Good-Turing", [] { return make_unique<GoodTuringPolicy>(); }},
+  };
+  cout << setw(24) << left << "tree" << setw(12) << "policy" << setw(10)
+       << right << "distance" << setw(12) << "us/sample" << setw(12)
+       << "converged"
+       << "\n";
+  for (auto &[TreeName, T, NumLeaves] : Trees)
+    for (auto &[PolicyName, Make] : Policies)
+      bench(TreeName, T, NumLeaves, PolicyName, Make);
+  return 0;
+}
@@ -49,6 +49,14 @@ int main() {
     WeightedSamplerGuide G;
     go(G);
   }
+  {
+    BloomGuide G;
+    go(G);
+  }
+  {
+    HybridGuide G;
+    go(G);
+  }
   {
     auto G1 = new DefaultGuide();
     auto G2 = new BFSGuide();
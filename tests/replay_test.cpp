@@ -0,0 +1,128 @@
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "gen_regex.h"
+#include "replay.h"
+
+/*
+ * save a bunch of regex generator choice sequences, some as choice
+ * files and some in a CorpusStore, then regenerate all of them in
+ * parallel and check that the output is unchanged; then check that
+ * divergences are noticed when the sequences and the generator no
+ * longer match
+ */
+
+const long N = 1000;
+const long MaxDepth = 10;
+const std::string Prefix("// ");
+const std::string StoreName("replay_test_store");
+
+using namespace std;
+using namespace tree_guide;
+
+int main() {
+  vector<vector<rec>> Seqs;
+  vector<string> Generated;
+  {
+    DefaultGuide G1(0);
+    SaverGuide G2(&G1, Prefix);
+    for (long i = 0; i < N; ++i) {
+      auto C = G2.makeChooser();
+      auto S = static_cast<SaverChooser *>(C.get());
+      Generated.push_back(gen(*S, 1 + (i % MaxDepth)));
+      Seqs.push_back(S->getChoices());
+      if (i < N / 2) {
+        ofstream Out("replay" + to_string(i) + ".txt");
+        Out << Generated.back() << "\n\n" << S->formatChoices() << "\n";
+      }
+    }
+  }
+
+  // the first half comes from files, the rest from a store, which
+  // drops duplicates; Orig maps corpus entries back to sequences
+  ReplayCorpus Corpus;
+  vector<long> Orig;
+  for (long i = 0; i < N / 2; ++i) {
+    Orig.push_back(i);
+    auto FN = "replay" + to_string(i) + ".txt";
+    if (!Corpus.addFile(FN, Prefix))
+      exit(-1);
+    remove(FN.c_str());
+  }
+  remove((StoreName + ".pack").c_str());
+  remove((StoreName + ".idx").c_str());
+  {
+    CorpusStore Store(StoreName);
+    for (long i = N / 2; i < N; ++i)
+      if (Store.append(Seqs.at(i)))
+        Orig.push_back(i);
+    Corpus.addStore(Store);
+  }
+  remove((StoreName + ".pack").c_str());
+  remove((StoreName + ".idx").c_str());
+  assert(Corpus.size() == Orig.size());
+
+  vector<string> Replayed(Corpus.size());
+  auto Stats = replay(
+      Corpus,
+      [&](Chooser &C, uint64_t I) {
+        Replayed.at(I) = gen(C, 1 + (Orig.at(I) % MaxDepth));
+      },
+      4);
+  cout << "faithful: " << Stats << "\n";
+  assert(Stats.Replayed == Corpus.size());
+  assert(Stats.Diverged.empty());
+  for (uint64_t i = 0; i < Corpus.size(); ++i)
+    assert(Replayed.at(i) == Generated.at(Orig.at(i)));
+
+  // a generator that makes no choices leaves saved values unused
+  Stats = replay(Corpus, [](Chooser &, uint64_t) {}, 4);
+  cout << "short generator: " << Stats << "\n";
+  assert(Stats.Diverged.size() == Corpus.size());
+
+  // truncated sequences run out before the generator finishes
+  ReplayCorpus Truncated;
+  for (auto &S : Seqs)
+    Truncated.add(vector<rec>(S.begin(), S.begin() + S.size() / 2));
+  Stats = replay(
+      Truncated,
+      [&](Chooser &C, uint64_t I) { gen(C, 1 + (I % MaxDepth)); }, 4);
+  cout << "truncated sequences: " << Stats << "\n";
+  assert(Stats.Diverged.size() > N / 2);
+  for (uint64_t i = 1; i < Stats.Diverged.size(); ++i)
+    assert(Stats.Diverged.at(i - 1) < Stats.Diverged.at(i));
+
+  {
+    // a BFS guide warmed up with a corpus never goes back to any of
+    // its paths
+    ReplayCorpus Warm;
+    unordered_set<uint64_t> Known;
+    DefaultGuide G1(1);
+    SaverGuide G2(&G1, Prefix);
+    for (long i = 0; i < N; ++i) {
+      auto C = G2.makeChooser();
+      gen(*C, MaxDepth);
+      Warm.add(static_cast<SaverChooser *>(C.get())->getChoices());
+      Known.insert(C->pathHash().Lo);
+    }
+    BFSGuide G(0);
+    Stats = ingest(
+        G, Warm, [&](Chooser &C, uint64_t) { gen(C, MaxDepth); }, 4);
+    cout << "ingested: " << Stats << "\n";
+    assert(Stats.Diverged.empty());
+    for (long i = 0; i < N; ++i) {
+      auto C = G.makeChooser();
+      assert(C);
+      gen(*C, MaxDepth);
+      assert(!Known.count(C->pathHash().Lo));
+    }
+  }
+
+  cout << "replay test passed\n";
+  return 0;
+}
@@ -38,8 +38,8 @@ static uint64_t test_maximally_unbalanced_helper(tree_guide::Chooser &C,
       C, Depth - 1, Number + BranchFactor - 1, BranchFactor);
 }
 
-static uint64_t test_maximally_unbalanced(tree_guide::Chooser &C,
-                                          uint64_t &NumLeaves) {
+static inline uint64_t test_maximally_unbalanced(tree_guide::Chooser &C,
+                                                 uint64_t &NumLeaves) {
   const int TreeDepth = 5;
   const int BranchFactor = 17;
   NumLeaves = (BranchFactor - 1) * (TreeDepth - 1) + BranchFactor;
@@ -69,7 +69,8 @@ static uint64_t ipow(uint64_t x, uint64_t y) {
   return Result;
 }
 
-static uint64_t test_full_tree(tree_guide::Chooser &C, uint64_t &NumLeaves) {
+static inline uint64_t test_full_tree(tree_guide::Chooser &C,
+                                      uint64_t &NumLeaves) {
   const int TreeDepth = 6;
   const int BranchFactor = 2;
   NumLeaves = ipow(BranchFactor, TreeDepth);
@@ -109,8 +110,8 @@ static uint64_t test_right_skewed_tree_helper(tree_guide::Chooser &C, int Depth,
   return test_right_skewed_tree_helper(C, Depth - 1, Number + Depth);
 }
 
-static uint64_t test_right_skewed_tree(tree_guide::Chooser &C,
-                                       uint64_t &NumLeaves) {
+static inline uint64_t test_right_skewed_tree(tree_guide::Chooser &C,
+                                              uint64_t &NumLeaves) {
   const int TreeDepth = 6;
 
   // A left tree of depth N has N + 1 leaves - one on the right, and N
@@ -177,8 +178,8 @@ static uint64_t test_path_with_thickets_helper(tree_guide::Chooser &C,
   }
 }
 
-static uint64_t test_path_with_thickets(tree_guide::Chooser &C,
-                                        uint64_t &NumLeaves) {
+static inline uint64_t test_path_with_thickets(tree_guide::Chooser &C,
+                                               uint64_t &NumLeaves) {
   const int Size = 50;
   const int BushSize = 8;
   NumLeaves = Size;
@@ -202,8 +203,8 @@ static uint64_t test_increasing_degree_tree_helper(tree_guide::Chooser &C,
   }
 }
 
-static uint64_t test_increasing_degree_tree(tree_guide::Chooser &C,
-                                            uint64_t &NumLeaves) {
+static inline uint64_t test_increasing_degree_tree(tree_guide::Chooser &C,
+                                                   uint64_t &NumLeaves) {
   const int TreeDepth = 6;
   NumLeaves = 1;
   for (int i = 1; i <= TreeDepth; ++i)
@@ -228,8 +229,8 @@ static uint64_t test_decreasing_degree_tree_helper(tree_guide::Chooser &C,
   }
 }
 
-static uint64_t test_decreasing_degree_tree(tree_guide::Chooser &C,
-                                            uint64_t &NumLeaves) {
+static inline uint64_t test_decreasing_degree_tree(tree_guide::Chooser &C,
+                                                   uint64_t &NumLeaves) {
   const int TreeDepth = 6;
   NumLeaves = 1;
   for (int i = 1; i <= TreeDepth; ++i)
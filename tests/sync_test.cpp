@@ -33,6 +33,8 @@ void make_choices() {
     Generated.push_back(S1);
     auto S2 = C2->formatChoices();
     Choices.push_back(S2);
+    mutator::add_fragments(C2->getChoices());
+    mutator::add_path(C2->getChoices());
     if (VERBOSE) {
       cout << i << ":\n";
       cout << S1 << "\n\n";
@@ -61,9 +63,19 @@ void printChoices(const vector<rec> &C) {
   cout << "\n\n";
 }
 
+bool balanced(const vector<rec> &C) {
+  long Depth = 0;
+  for (auto r : C) {
+    if (r.k == RecKind::START)
+      ++Depth;
+    if (r.k == RecKind::END && --Depth < 0)
+      return false;
+  }
+  return Depth == 0;
+}
+
 int use_choices() {
   int pass = 0;
-  mutator::init(std::random_device{}());
   for (int i = 0; i < N; ++i) {
     long Depth = 1 + (i % MaxDepth);
     FileGuide FG;
@@ -82,6 +94,7 @@ int use_choices() {
     }
 
     mutator::mutate_choices(Ch);
+    assert(balanced(Ch));
     
     if (VERBOSE) {
       cout << "mutated choices:\n";
@@ -113,8 +126,68 @@ int use_choices() {
   return pass;
 }
 
+/*
+ * tree-guided mutation should mostly change the value at the node
+ * that's been visited least, and there it should try a branch that
+ * hasn't been taken, if the values taken so far show one
+ */
+void guided_mutations() {
+  mutator::init(1);
+  auto path = [](uint64_t A, uint64_t B) {
+    return vector<rec>{{RecKind::NUM, A}, {RecKind::NUM, B}};
+  };
+  // the first choice is well trodden, and is followed by 0, except
+  // that after an 8 we've seen 1 and 2 once each, and after a 9, 0
+  // and 1
+  for (int i = 0; i < 25; ++i)
+    for (uint64_t A = 0; A < 8; ++A)
+      mutator::add_path(path(A, 0));
+  mutator::add_path(path(8, 1));
+  mutator::add_path(path(8, 2));
+  mutator::add_path(path(9, 0));
+  mutator::add_path(path(9, 1));
+  assert(mutator::find_path(path(8, 2)));
+  assert(!mutator::find_path(path(8, 0)));
+
+  const long Trials = 2000;
+  long First = 0, Second = 0, NewBranch = 0;
+  for (long i = 0; i < Trials; ++i) {
+    auto C = path(8, 1);
+    mutator::mutate_choices(C);
+    First += C[0].v != 8;
+    Second += C[1].v != 1;
+    NewBranch += C[1].v == 0;
+  }
+  if (VERBOSE)
+    cout << "guided: " << First << " first, " << Second << " second, "
+         << NewBranch << " new branch\n";
+  assert(Second > 2 * First);
+  assert(NewBranch > Trials / 10);
+
+  // 0 and 1 leave no gap, so 2 isn't known to be a branch, and the
+  // guided changes try the other branch instead
+  long Other = 0, Past = 0;
+  for (long i = 0; i < Trials; ++i) {
+    auto C = path(9, 0);
+    mutator::mutate_choices(C);
+    Other += C[1].v == 1;
+    Past += C[1].v == 2;
+  }
+  if (VERBOSE)
+    cout << "guided: " << Other << " other branch, " << Past << " past\n";
+  assert(Other > Trials / 10);
+  assert(Past * 20 < Other);
+}
+
 int main() {
+  guided_mutations();
+  mutator::init(std::random_device{}());
   make_choices();
+  // the test cases' scopes go into the pool that mutation splices
+  // from, which stays within its bound
+  assert(mutator::num_fragments() > 0);
+  mutator::set_max_fragments(100);
+  assert(mutator::num_fragments() == 100);
   auto pass = use_choices();
   cout << pass << " tests passed.\n";
 }
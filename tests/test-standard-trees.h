@@ -30,7 +30,8 @@
 
 TEMPLATE_TEST_CASE("Can discover all leaves in standard trees",
                    "[test][template]", tree_guide::BFSGuide,
-                   tree_guide::WeightedSamplerGuide) {
+                   tree_guide::BestFirstGuide, tree_guide::WeightedSamplerGuide,
+                   tree_guide::BloomGuide, tree_guide::HybridGuide) {
   TestType G;
   const int REPS = 10000;
   std::vector<int> Results;
@@ -1,9 +1,23 @@
+#include <catch2/catch_approx.hpp>
 #include <catch2/catch_template_test_macros.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/generators/catch_generators.hpp>
 
+#include <set>
+#include <sstream>
+
+#include "edge-cover.h"
 #include "guide.h"
+#include "path-index.h"
 #include "standard-trees.h"
 
+#include "bfs.h"
+#include "bloom.h"
+#include "corpus.h"
+#include "cover.h"
+#include "dedup.h"
+#include "hybrid.h"
+#include "paths.h"
 #include "test-standard-trees.h"
+#include "values.h"
 #include "weighted-sampler.h"
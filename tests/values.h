@@ -0,0 +1,55 @@
+TEST_CASE("Interesting values turn up often") {
+  tree_guide::InterestingValues Values;
+  std::set<uint64_t> Builtin(Values.builtin().begin(), Values.builtin().end());
+  REQUIRE(Builtin.count(0));
+  REQUIRE(Builtin.count(~0ULL));
+  REQUIRE(Builtin.count(0x7fffffff));
+  REQUIRE(Builtin.count((uint64_t)INT64_MIN));
+  REQUIRE(Builtin.count(1ULL << 40));
+  std::mt19937_64 R(0);
+  int Hits = 0;
+  for (int i = 0; i < 1000; ++i)
+    Hits += Builtin.count(Values.next(R));
+  REQUIRE(Hits > 400);
+  REQUIRE(Hits < 600);
+}
+
+TEST_CASE("Interesting values can be harvested") {
+  tree_guide::InterestingValues Values(1.0, 10);
+  std::vector<tree_guide::rec> Choices{{tree_guide::RecKind::START, 0},
+                                       {tree_guide::RecKind::NUM, 12345678},
+                                       {tree_guide::RecKind::NUM, 0},
+                                       {tree_guide::RecKind::END, 0}};
+  Values.harvest(Choices);
+  Values.harvest(Choices);
+  // values that are already built in don't count
+  REQUIRE(Values.harvested() == std::vector<uint64_t>{12345678});
+  std::mt19937_64 R(0);
+  int Hits = 0;
+  for (int i = 0; i < 1000; ++i)
+    Hits += Values.next(R) == 12345678;
+  REQUIRE(Hits > 400);
+  for (uint64_t V = 1000; V < 1100; ++V)
+    Values.add(V);
+  REQUIRE(Values.harvested().size() == 10);
+}
+
+TEST_CASE("Choosers get unimportant values from a value source") {
+  tree_guide::InterestingValues Values(1.0);
+  std::set<uint64_t> Builtin(Values.builtin().begin(), Values.builtin().end());
+  tree_guide::DefaultGuide G1(0);
+  G1.setValueSource(&Values);
+  auto C1 = G1.makeChooser();
+  for (int i = 0; i < 100; ++i)
+    REQUIRE(Builtin.count(C1->chooseUnimportant()));
+
+  // a file chooser falls back on it once its choices run out
+  tree_guide::FileGuide G2(0);
+  G2.setSync(tree_guide::Sync::NONE);
+  G2.setValueSource(&Values);
+  G2.replaceChoices({{tree_guide::RecKind::NUM, 12345678}});
+  auto C2 = G2.makeChooser();
+  REQUIRE(C2->chooseUnimportant() == 12345678);
+  for (int i = 0; i < 100; ++i)
+    REQUIRE(Builtin.count(C2->chooseUnimportant()));
+}
@@ -87,3 +87,170 @@ TEST_CASE("Basic frequency checks") {
     REQUIRE(freq[2] >= 0.2);
   }
 }
+
+template <typename F> void check_exhaustion(F Tree) {
+  tree_guide::WeightedSamplerGuide G;
+  G.setStopWhenExhausted(true);
+  std::vector<int> Results;
+  uint64_t NumLeaves = 0;
+  uint64_t Traversals = 0;
+  while (auto C = G.makeChooser()) {
+    auto Res = Tree(*C, NumLeaves);
+    if (Res >= Results.size())
+      Results.resize(Res + 1);
+    // every traversal has to reach a leaf we haven't seen before
+    REQUIRE(Results.at(Res) == 0);
+    ++Results.at(Res);
+    ++Traversals;
+  }
+  REQUIRE(G.isExhausted());
+  REQUIRE(Traversals == NumLeaves);
+  REQUIRE(Results.size() == NumLeaves);
+}
+
+TEST_CASE("Exhausted subtrees are pruned") {
+  SECTION("maximally_unbalanced") {
+    check_exhaustion(test_maximally_unbalanced);
+  }
+  SECTION("full_tree") { check_exhaustion(test_full_tree); }
+  SECTION("right_skewed_tree") { check_exhaustion(test_right_skewed_tree); }
+  SECTION("path_with_thickets") { check_exhaustion(test_path_with_thickets); }
+  SECTION("increasing_degree_tree") {
+    check_exhaustion(test_increasing_degree_tree);
+  }
+  SECTION("decreasing_degree_tree") {
+    check_exhaustion(test_decreasing_degree_tree);
+  }
+}
+
+template <typename F> void check_sampler_batches(F Tree, uint64_t K) {
+  tree_guide::WeightedSamplerGuide G;
+  G.setStopWhenExhausted(true);
+  std::vector<int> Results;
+  uint64_t NumLeaves = 0;
+  for (;;) {
+    auto Choosers = G.makeChoosers(K);
+    if (Choosers.empty())
+      break;
+    REQUIRE(Choosers.size() <= K);
+    std::set<uint64_t> Batch;
+    for (auto &C : Choosers) {
+      auto Res = Tree(*C, NumLeaves);
+      // traversals in the same batch never reach the same leaf
+      REQUIRE(Batch.insert(Res).second);
+      if (Res >= Results.size())
+        Results.resize(Res + 1);
+      ++Results.at(Res);
+    }
+  }
+  REQUIRE(G.isExhausted());
+  REQUIRE(Results.size() == NumLeaves);
+  for (auto N : Results)
+    REQUIRE(N > 0);
+}
+
+TEST_CASE("Batches of traversals reach distinct leaves") {
+  for (uint64_t K : {2, 8, 32}) {
+    check_sampler_batches(test_maximally_unbalanced, K);
+    check_sampler_batches(test_full_tree, K);
+    check_sampler_batches(test_right_skewed_tree, K);
+    check_sampler_batches(test_path_with_thickets, K);
+    check_sampler_batches(test_increasing_degree_tree, K);
+    check_sampler_batches(test_decreasing_degree_tree, K);
+  }
+
+  SECTION("once the tree is known, a batch can cover it") {
+    tree_guide::WeightedSamplerGuide G;
+    uint64_t NumLeaves;
+    while (!G.isExhausted()) {
+      auto C = G.makeChooser();
+      test_full_tree(*C, NumLeaves);
+    }
+    auto Choosers = G.makeChoosers(2 * NumLeaves);
+    REQUIRE(Choosers.size() == NumLeaves);
+    std::set<uint64_t> Batch;
+    for (auto &C : Choosers)
+      Batch.insert(test_full_tree(*C, NumLeaves));
+    REQUIRE(Batch.size() == NumLeaves);
+  }
+}
+
+TEST_CASE("Ingested paths count as explored") {
+  SECTION("partial ingestion is never revisited") {
+    tree_guide::DefaultGuide DG(0);
+    tree_guide::WeightedSamplerGuide G;
+    G.setStopWhenExhausted(true);
+    std::set<uint64_t> Seen;
+    uint64_t NumLeaves;
+    for (int i = 0; i < 20; ++i) {
+      auto C = DG.makeChooser();
+      tree_guide::TracingChooser T(*C);
+      Seen.insert(test_path_with_thickets(T, NumLeaves));
+      REQUIRE(G.ingest(T.steps()));
+    }
+    while (auto C = G.makeChooser())
+      REQUIRE(Seen.insert(test_path_with_thickets(*C, NumLeaves)).second);
+    REQUIRE(Seen.size() == NumLeaves);
+  }
+
+  SECTION("ingesting every leaf exhausts the tree with exact estimates") {
+    tree_guide::BFSGuide BFS;
+    tree_guide::WeightedSamplerGuide G;
+    std::vector<double> Weights = {0.1, 0.4, 0.2, 0.3};
+    uint64_t NumLeaves = 0;
+    while (auto C = BFS.makeChooser()) {
+      tree_guide::TracingChooser T(*C);
+      T.chooseWeighted(Weights);
+      test_full_tree(T, NumLeaves);
+      REQUIRE(G.ingest(T.steps()));
+    }
+    REQUIRE(G.isExhausted());
+    REQUIRE(G.sizeEstimate() == Catch::Approx(Weights.size() * NumLeaves));
+  }
+}
+
+TEST_CASE("Guides can start from another guide's tree") {
+  SECTION("BFS to weighted sampler") {
+    tree_guide::BFSGuide BFS(0);
+    std::set<uint64_t> Seen;
+    uint64_t NumLeaves;
+    for (int i = 0; i < 10; ++i) {
+      auto C = BFS.makeChooser();
+      REQUIRE(C);
+      Seen.insert(test_right_skewed_tree(*C, NumLeaves));
+    }
+    tree_guide::WeightedSamplerGuide G(0);
+    G.setStopWhenExhausted(true);
+    G.transferFrom(BFS);
+    // BFS's leaves are exhausted, so we only go to new ones
+    while (auto C = G.makeChooser())
+      REQUIRE(Seen.insert(test_right_skewed_tree(*C, NumLeaves)).second);
+    REQUIRE(Seen.size() == NumLeaves);
+  }
+
+  SECTION("a finished BFS gives exact sizes") {
+    tree_guide::BFSGuide BFS(0);
+    uint64_t NumLeaves;
+    while (auto C = BFS.makeChooser())
+      test_path_with_thickets(*C, NumLeaves);
+    tree_guide::WeightedSamplerGuide G(0);
+    G.transferFrom(BFS);
+    REQUIRE(G.isExhausted());
+    REQUIRE(G.sizeEstimate() == Catch::Approx(NumLeaves));
+  }
+
+  SECTION("weighted sampler to best-first") {
+    tree_guide::WeightedSamplerGuide WS(0);
+    std::set<uint64_t> Seen;
+    uint64_t NumLeaves;
+    for (int i = 0; i < 30; ++i) {
+      auto C = WS.makeChooser();
+      Seen.insert(test_increasing_degree_tree(*C, NumLeaves));
+    }
+    tree_guide::BestFirstGuide G(0);
+    G.transferFrom(WS);
+    while (auto C = G.makeChooser())
+      REQUIRE(Seen.insert(test_increasing_degree_tree(*C, NumLeaves)).second);
+    REQUIRE(Seen.size() == NumLeaves);
+  }
+}